@@ -0,0 +1,198 @@
+/*
+ * cli_command_bench.c
+ *
+ * Time of finding the command of a line among thousands of commands known
+ * at build time: the perfect hash of the generated table, the walk down
+ * the radix trees of the registry, and a linear strncmp() scan as the
+ * commands were once found. The source of the registry is included so its
+ * lookups may be timed apart. Built and run from the top of the tree, a
+ * first time to write the spec of the commands, then with their table:
+ *
+ *     cc -Iinclude -o cli_command_gen tools/cli_command_gen.c
+ *     cc -O2 -Iinclude -Isrc -o cli_command_bench bench/cli_command_bench.c \
+ *        src/cli_command_table.c src/tinyrl*.c -lpthread
+ *     ./cli_command_bench spec 4000 > bench_table.def
+ *     ./cli_command_gen bench_table.def > bench_table.c
+ *     cc -O2 -Iinclude -Isrc -o cli_command_bench bench/cli_command_bench.c \
+ *        bench_table.c src/tinyrl*.c -lpthread
+ *     ./cli_command_bench
+ *
+ * The spec holds three word commands (verb, object, leaf); each line looked
+ * up is a command followed by two arguments.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cli_command.c"
+
+#define BENCH_ROUNDS 200
+
+static const char *const bench_verb[] = {
+	"show", "clear", "set", "debug", "reset", "monitor", "test", "copy",
+	"delete", "ping"
+};
+static const char *const bench_object[] = {
+	"interface", "route", "vrf", "tunnel", "bgp", "ospf", "isis", "mpls",
+	"lldp", "arp", "ntp", "snmp", "logging", "users", "system", "vlan",
+	"policy", "queue", "acl", "counters"
+};
+
+/* the handlers of the generated tables */
+void bench_command(tinyrl_t *this, int argc, const cli_token_t *argv)
+{
+}
+
+void cli_command_1(tinyrl_t *this, int argc, const cli_token_t *argv)
+{
+}
+
+void cli_command_2(tinyrl_t *this, int argc, const cli_token_t *argv)
+{
+}
+
+/* a line to look up, as typed and split in words */
+struct bench_line {
+	char text[128];
+	char words[128];
+	cli_token_t argv[CLI_COMMAND_ARGS];
+	int argc;
+	const cli_command_static_t *command;
+};
+
+/*------------------------------------- */
+static double bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*------------------------------------- */
+/*
+ * Write the spec of count commands, made of the verbs, the objects and
+ * random leaves.
+ */
+static int bench_spec(unsigned count)
+{
+	unsigned i;
+
+	srand(1);
+	printf("# %u commands for cli_command_bench\n", count);
+	for (i = 0; i < count; i++)
+		printf("%s %s leaf%u%c\t| bench_command\t|\t|\n",
+		       bench_verb[i % 10], bench_object[i / 10 % 20], i,
+		       'a' + rand() % 26);
+	return EXIT_SUCCESS;
+}
+
+/*------------------------------------- */
+/*
+ * Linear scan of the commands for the longest one the line starts with,
+ * word by word, as cli_telnet_find_command() compared the first word of a
+ * line with each command in turn.
+ */
+static const cli_command_static_t *bench_linear(const char *line)
+{
+	const cli_command_static_t *best = NULL;
+	size_t best_len = 0, len;
+	unsigned i;
+
+	for (i = 0; i < cli_command_static_count; i++) {
+		const cli_command_static_t *entry = &cli_command_static[i];
+
+		if (!entry->func)
+			continue;
+		len = entry->word + entry->len;
+		if (len > best_len && !strncmp(line, entry->path, len)
+		    && (line[len] == ' ' || !line[len])) {
+			best = entry;
+			best_len = len;
+		}
+	}
+	return best;
+}
+
+/*------------------------------------- */
+int main(int argc, char **argv)
+{
+	struct bench_line *lines;
+	unsigned long sink = 0;
+	double start, linear, radix, hash, find;
+	unsigned i, n = 0, round;
+	int used, rest;
+
+	if (argc > 1 && !strcmp(argv[1], "spec"))
+		return bench_spec(argc > 2 ? strtoul(argv[2], NULL, 0) : 4000);
+
+	lines = calloc(cli_command_static_count, sizeof(*lines));
+	if (!lines || cli_command_init()) {
+		fprintf(stderr, "FAIL: setup\n");
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < cli_command_static_count; i++) {
+		struct bench_line *line = &lines[n];
+
+		if (!cli_command_static[i].func)
+			continue;
+		snprintf(line->text, sizeof(line->text), "%s arg1 arg2", cli_command_static[i].path);
+		strcpy(line->words, line->text);
+		line->argc = cli_command_tokenize(line->words, line->argv, CLI_COMMAND_ARGS);
+		line->command = &cli_command_static[i];
+		n++;
+	}
+
+	/* every lookup finds the command of the line */
+	for (i = 0; i < n; i++) {
+		cli_command_t *command = cli_command_find(lines[i].argc, lines[i].argv, &used);
+
+		if (bench_linear(lines[i].text) != lines[i].command
+		    || !command || strcmp(command->path, lines[i].command->path)
+		    || cli_command_lookup(&cli_command_root, lines[i].argc, lines[i].argv, &rest) != command) {
+			fprintf(stderr, "FAIL: %s\n", lines[i].text);
+			return EXIT_FAILURE;
+		}
+	}
+
+	printf("%u commands, %u lookups per round, ns per lookup\n\n", n, n * BENCH_ROUNDS);
+	printf("%10s%10s%16s%22s\n", "linear", "radix", "hash + radix", "cli_command_find()");
+	for (round = 0; round < 3; round++) {
+		/* a single pass, the scan takes as long as the others many times */
+		start = bench_now();
+		for (i = 0; i < n; i++)
+			sink += (unsigned long) bench_linear(lines[i].text);
+		linear = (bench_now() - start) * BENCH_ROUNDS;
+
+		start = bench_now();
+		for (i = 0; i < n * BENCH_ROUNDS; i++)
+			sink += (unsigned long) cli_command_lookup(&cli_command_root, lines[i % n].argc,
+								   lines[i % n].argv, &used);
+		radix = bench_now() - start;
+
+		start = bench_now();
+		for (i = 0; i < n * BENCH_ROUNDS; i++) {
+			struct bench_line *line = &lines[i % n];
+			cli_command_t *command = cli_command_lookup_static(line->argc, line->argv, &used);
+
+			sink += (unsigned long) cli_command_lookup(command, line->argc - used,
+								   line->argv + used, &rest);
+		}
+		hash = bench_now() - start;
+
+		start = bench_now();
+		for (i = 0; i < n * BENCH_ROUNDS; i++)
+			sink += (unsigned long) cli_command_find(lines[i % n].argc, lines[i % n].argv, &used);
+		find = bench_now() - start;
+
+		printf("%10.1f%10.1f%16.1f%22.1f\n", linear / (n * BENCH_ROUNDS),
+		       radix / (n * BENCH_ROUNDS), hash / (n * BENCH_ROUNDS),
+		       find / (n * BENCH_ROUNDS));
+	}
+
+	cli_command_deinit();
+	free(lines);
+	return sink == 1 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
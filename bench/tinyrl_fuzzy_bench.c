@@ -0,0 +1,125 @@
+/*
+ * tinyrl_fuzzy_bench.c
+ *
+ * Time of a fuzzy ranking over a large set of object names, with each of
+ * the scans (scalar, SSE2, AVX2) the CPU runs. The source of the set is
+ * included so the scan may be chosen. Built and run from the top of the
+ * tree:
+ *
+ *     cc -O2 -Iinclude -Isrc -o tinyrl_fuzzy_bench bench/tinyrl_fuzzy_bench.c
+ *     ./tinyrl_fuzzy_bench [words [runs]]
+ *
+ * The words (1M by default) look like "tunnel-gre-stark-lon3-00062", each
+ * ranking keeps the 16 best, and the best of the runs (15 by default) is
+ * reported.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tinyrl_fuzzy.c"
+
+#define BENCH_K 16
+
+static const char *const bench_kind[] = {
+	"tunnel-gre", "tunnel-ipip", "vrf", "customer", "peer-bgp", "lsp-te"
+};
+static const char *const bench_name[] = {
+	"stark", "acme", "globex", "initech", "umbrella", "hooli", "wonka",
+	"tyrell", "cyberdyne", "soylent", "gloams", "vandelay"
+};
+static const char *const bench_site[] = {
+	"lon3", "par1", "fra2", "nyc4", "sin1", "syd2", "ams5", "mad1"
+};
+static const char *const bench_fragment[] = {
+	"a", "vr", "acme", "gloams", "tgrestark", "cust-ini-42", "zz"
+};
+
+/*------------------------------------- */
+static double bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/*------------------------------------- */
+static double bench_rank(const struct tinyrl_fuzzy *fuzzy, const char *fragment,
+			 unsigned runs)
+{
+	const char *best[BENCH_K];
+	double start, elapsed, min = 0;
+	unsigned i;
+
+	for (i = 0; i < runs; i++) {
+		start = bench_now();
+		tinyrl_fuzzy_rank(fuzzy, fragment, strlen(fragment), best, BENCH_K);
+		elapsed = bench_now() - start;
+		if (!i || elapsed < min)
+			min = elapsed;
+	}
+	return min;
+}
+
+/*------------------------------------- */
+int main(int argc, char **argv)
+{
+	unsigned count = argc > 1 ? strtoul(argv[1], NULL, 0) : 1000000;
+	unsigned runs = argc > 2 ? strtoul(argv[2], NULL, 0) : 15;
+	struct {
+		const char *name;
+		fuzzy_scan_t *scan;
+	} scans[3];
+	struct tinyrl_fuzzy *fuzzy = tinyrl_fuzzy_new();
+	char *words, *word;
+	unsigned i, j, n = 0;
+
+	words = malloc((size_t) count * 32);
+	if (!fuzzy || !words || !runs) {
+		fprintf(stderr, "usage: %s [words [runs]]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	srand(1);
+	for (i = 0, word = words; i < count; i++, word += 32) {
+		snprintf(word, 32, "%s-%s-%s-%05u",
+			 bench_kind[rand() % 6], bench_name[rand() % 12],
+			 bench_site[rand() % 8], i % 100000);
+		if (!tinyrl_fuzzy_add(fuzzy, word)) {
+			fprintf(stderr, "out of memory\n");
+			return EXIT_FAILURE;
+		}
+	}
+
+	scans[n].name = "scalar";
+	scans[n++].scan = fuzzy_scan_scalar;
+#if defined(FUZZY_X86)
+	scans[n].name = "SSE2";
+	scans[n++].scan = fuzzy_scan_sse2;
+	if (__builtin_cpu_supports("avx2")) {
+		scans[n].name = "AVX2";
+		scans[n++].scan = fuzzy_scan_avx2;
+	}
+#endif
+
+	printf("%u words, k = %u, best of %u runs, ms per ranking\n\n",
+	       count, BENCH_K, runs);
+	printf("%-12s", "fragment");
+	for (j = 0; j < n; j++)
+		printf("%10s", scans[j].name);
+	printf("\n");
+	for (i = 0; i < sizeof(bench_fragment) / sizeof(bench_fragment[0]); i++) {
+		printf("%-12s", bench_fragment[i]);
+		for (j = 0; j < n; j++) {
+			fuzzy->scan = scans[j].scan;
+			printf("%10.2f", bench_rank(fuzzy, bench_fragment[i], runs));
+		}
+		printf("\n");
+	}
+
+	tinyrl_fuzzy_delete(fuzzy);
+	free(words);
+	return EXIT_SUCCESS;
+}
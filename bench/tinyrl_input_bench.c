@@ -0,0 +1,177 @@
+/*
+ * tinyrl_input_bench.c
+ *
+ * Cost per byte of a large paste into a socket session, read in chunks of
+ * a few sizes: the screens socket input once went through before reaching
+ * the editor (a regex compiled on every read, then a byte class table),
+ * and tinyrl_feed() as the input is now handed over, with nothing in
+ * front. Built and run from the top of the tree:
+ *
+ *     cc -O2 -Iinclude -o tinyrl_input_bench bench/tinyrl_input_bench.c \
+ *        src/tinyrl*.c -lpthread
+ *     ./tinyrl_input_bench [megabytes]
+ *
+ * The paste (10 MB by default) is made of command lines ended by enter.
+ * The regex is freed after each read, which the old screen did not do.
+ */
+#include <regex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tinyrl.h"
+
+static const char *const bench_word[] = {
+	"show", "interface", "eth0", "counters", "detail", "vrf", "blue",
+	"route", "10.0.0.1/24", "set", "mtu", "9000", "description", "uplink"
+};
+static const size_t bench_chunk[] = { 8, 64, 4096 };
+
+/* the bytes let through by the byte class table */
+static const unsigned char bench_class[256] = {
+	['a' ... 'z'] = 1,
+	['A' ... 'Z'] = 1,
+	['0' ... '9'] = 1,
+	['.'] = 1,
+	[' '] = 1,
+	['_'] = 1,
+	['\t'] = 1,
+	['\n'] = 1,
+	['\r'] = 1,
+	[127] = 1,
+	['?'] = 1,
+};
+
+/*------------------------------------- */
+static double bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*------------------------------------- */
+static ssize_t bench_write(void *context, const char *buf, size_t len)
+{
+	return len;
+}
+
+/*------------------------------------- */
+static int bench_regex(const char *bytes, size_t len)
+{
+	regex_t start_state;
+	regmatch_t range;
+	int valid;
+
+	range.rm_so = 0;
+	range.rm_eo = len;
+	regcomp(&start_state, "[a-zA-Z0-9. _\t\n\r\177\?]", REG_EXTENDED);
+	valid = regexec(&start_state, bytes, 1, &range, REG_STARTEND) == 0;
+	regfree(&start_state);
+	return valid;
+}
+
+/*------------------------------------- */
+static int bench_table(const char *bytes, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		if (bench_class[(unsigned char) bytes[i]])
+			return 1;
+	}
+	return 0;
+}
+
+/*------------------------------------- */
+/*
+ * Screen the paste read chunk bytes at a time, return the time taken in ns.
+ */
+static double bench_screen(int (*screen)(const char *, size_t), const char *paste,
+			   size_t size, size_t chunk, unsigned long *sink)
+{
+	double start = bench_now();
+	size_t i;
+
+	for (i = 0; i < size; i += chunk)
+		*sink += screen(paste + i, size - i < chunk ? size - i : chunk);
+	return bench_now() - start;
+}
+
+/*------------------------------------- */
+/*
+ * Feed the paste read chunk bytes at a time to a line editor, return the
+ * time taken in ns.
+ */
+static double bench_feed(const char *paste, size_t size, size_t chunk,
+			 unsigned long *sink)
+{
+	FILE *in = tmpfile(), *out = tmpfile();
+	tinyrl_t *t = tinyrl_new(in, out);
+	size_t i, len, used;
+	double start;
+
+	tinyrl__set_output(t, bench_write, NULL);
+	start = bench_now();
+	tinyrl_readline_begin(t, "CLI> ");
+	for (i = 0; i < size; i += len) {
+		len = size - i < chunk ? size - i : chunk;
+		while (tinyrl_feed(t, paste + i, len, &used) == TINYRL_FEED_LINE) {
+			char *line = tinyrl_readline_end(t);
+
+			*sink += strlen(line);
+			free(line);
+			tinyrl_readline_begin(t, "CLI> ");
+			i += used;
+			len -= used;
+		}
+	}
+	start = bench_now() - start;
+
+	tinyrl_delete(t);
+	fclose(in);
+	fclose(out);
+	return start;
+}
+
+/*------------------------------------- */
+int main(int argc, char **argv)
+{
+	size_t size = (argc > 1 ? strtoul(argv[1], NULL, 0) : 10) << 20;
+	unsigned long sink = 0;
+	char *paste = malloc(size);
+	size_t i, j, len;
+
+	if (!paste || !size) {
+		fprintf(stderr, "usage: %s [megabytes]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	/* lines of 6 to 10 words */
+	srand(1);
+	for (i = 0, j = 0; i < size; j++) {
+		const char *word = bench_word[rand() % 14];
+
+		len = strlen(word);
+		if (i + len + 1 > size)
+			break;
+		memcpy(paste + i, word, len);
+		i += len;
+		paste[i++] = j % 10 > 4 && rand() % 2 ? '\r' : ' ';
+	}
+	memset(paste + i, ' ', size - i);
+
+	printf("%zu MB paste, ns per byte\n\n", size >> 20);
+	printf("%8s%12s%12s%16s\n", "read", "regex", "table", "tinyrl_feed()");
+	for (i = 0; i < sizeof(bench_chunk) / sizeof(bench_chunk[0]); i++) {
+		printf("%8zu", bench_chunk[i]);
+		printf("%12.3f", bench_screen(bench_regex, paste, size, bench_chunk[i], &sink) / size);
+		printf("%12.3f", bench_screen(bench_table, paste, size, bench_chunk[i], &sink) / size);
+		printf("%16.3f\n", bench_feed(paste, size, bench_chunk[i], &sink) / size);
+	}
+
+	free(paste);
+	return sink == 1 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,105 @@
+/*
+ * tinyrl_redisplay_bench.c
+ *
+ * Bytes sent to a socket session per keystroke for a few usual edits,
+ * each key read on its own as from a telnet client in character mode,
+ * next to the bytes of a repaint of the whole line ("\r\x1b[0K", prompt
+ * and line) as the socket sessions once got on every key. Built and run
+ * from the top of the tree:
+ *
+ *     cc -O2 -Iinclude -o tinyrl_redisplay_bench bench/tinyrl_redisplay_bench.c \
+ *        src/tinyrl*.c -lpthread
+ *     ./tinyrl_redisplay_bench
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tinyrl.h"
+
+#define BENCH_PROMPT "router-01(config)# "
+#define BENCH_LINE "show interface eth0 counters detail vrf blue"
+#define BENCH_LONG BENCH_LINE " " BENCH_LINE " " BENCH_LINE " " BENCH_LINE
+
+#define LEFT "\x1b[D"
+#define RIGHT "\x1b[C"
+#define BACKSPACE "\x7f"
+#define DELETE "\x04"
+
+/* keys of a trace: key typed repeat times, or each character of key */
+struct bench_step {
+	const char *key;
+	unsigned repeat;
+};
+
+static const struct bench_trace {
+	const char *name;
+	const char *setup;	/* typed at once before the trace */
+	struct bench_step steps[2];
+} bench_trace[] = {
+	{ "type", "", { { BENCH_LINE, 0 } } },
+	{ "type, wrapped", "", { { BENCH_LONG, 0 } } },
+	{ "left, right", BENCH_LINE, { { LEFT, 20 }, { RIGHT, 20 } } },
+	{ "backspace", BENCH_LINE, { { BACKSPACE, 10 } } },
+	{ "insert mid-line", BENCH_LINE, { { LEFT, 15 }, { "brief ", 0 } } },
+	{ "delete mid-line", BENCH_LINE, { { LEFT, 15 }, { DELETE, 5 } } },
+};
+
+/*------------------------------------- */
+static ssize_t bench_write(void *context, const char *buf, size_t len)
+{
+	*(unsigned long *) context += len;
+	return len;
+}
+
+/*------------------------------------- */
+static void bench_key(tinyrl_t *t, const char *key, size_t len,
+		      unsigned long *keys, unsigned long *repaint)
+{
+	tinyrl_feed(t, key, len, NULL);
+	*keys += 1;
+	*repaint += strlen("\r\x1b[0K" BENCH_PROMPT) + tinyrl__get_end(t);
+}
+
+/*------------------------------------- */
+int main(void)
+{
+	unsigned long bytes, keys, repaint;
+	unsigned i, j, k;
+
+	printf("prompt of %zu characters, 80 columns, bytes per keystroke\n\n",
+	       strlen(BENCH_PROMPT));
+	printf("%-18s%6s%12s%12s\n", "trace", "keys", "redisplay", "repaint");
+	for (i = 0; i < sizeof(bench_trace) / sizeof(bench_trace[0]); i++) {
+		const struct bench_trace *trace = &bench_trace[i];
+		FILE *in = tmpfile(), *out = tmpfile();
+		tinyrl_t *t = tinyrl_new(in, out);
+
+		if (!t) {
+			fprintf(stderr, "out of memory\n");
+			return EXIT_FAILURE;
+		}
+		tinyrl__set_output(t, bench_write, &bytes);
+		tinyrl_readline_begin(t, BENCH_PROMPT);
+		tinyrl_feed(t, trace->setup, strlen(trace->setup), NULL);
+
+		bytes = keys = repaint = 0;
+		for (j = 0; j < 2 && trace->steps[j].key; j++) {
+			const struct bench_step *step = &trace->steps[j];
+
+			if (!step->repeat) {
+				for (k = 0; step->key[k]; k++)
+					bench_key(t, step->key + k, 1, &keys, &repaint);
+			}
+			for (k = 0; k < step->repeat; k++)
+				bench_key(t, step->key, strlen(step->key), &keys, &repaint);
+		}
+
+		printf("%-18s%6lu%12.1f%12.1f\n", trace->name, keys,
+		       (double) bytes / keys, (double) repaint / keys);
+		tinyrl_delete(t);
+		fclose(in);
+		fclose(out);
+	}
+	return EXIT_SUCCESS;
+}
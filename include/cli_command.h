@@ -0,0 +1,83 @@
+/**
+ * @file cli_command.h
+ * @brief Registry of the commands, shared by the CLI over the tty and over
+ *        telnet.
+ *
+ * A command is a path of words ("show interface counters"). Each word is a
+ * node of a tree, and the words following a node are indexed in a radix
+ * tree, so finding a command takes the time of its words whatever the
+ * number of commands registered. Commands are registered at any time and
+ * in any order, e.g. by plugins while sessions are running; they are only
+ * removed by cli_command_deinit().
+ */
+
+#ifndef CLI_COMMAND_H_
+#define CLI_COMMAND_H_
+
+#include <main.h>
+#include "cli_command_hash.h"
+
+/** @brief Most words of a command line, arguments included */
+#define CLI_COMMAND_ARGS 64
+
+/** @brief Word of a command line, quotes and escapes removed, null terminated */
+typedef struct
+{
+	const char *s; /**@brief The word, in the line */
+	size_t len;
+} cli_token_t;
+
+/** @brief Function running a command, argv are the words after the command */
+typedef void cli_command_func_t(tinyrl_t *this, int argc, const cli_token_t *argv);
+
+/** @brief Completion of the values of a command argument */
+typedef struct
+{
+	tinyrl_provider_func_t *func; /**@brief Fetches the values, in the background */
+	struct tinyrl_provider *provider; /**@brief Values cached */
+} cli_argument_t;
+
+/** @brief Word of a command */
+typedef struct cli_command
+{
+	char *name; /**@brief The word */
+	char *path; /**@brief The words from the first one, e.g. "show interface counters" */
+	cli_command_func_t *func; /**@brief Function to call, NULL for a word only leading to other commands */
+	char *doc; /**@brief Command documentation */
+	cli_argument_t *args; /**@brief Arguments whose values complete */
+	unsigned args_count;
+	bool args_path; /**@brief The arguments are the words of a command (e.g. help) */
+	struct tinyrl_radix *children; /**@brief Words following this one, NULL if none */
+	struct tinyrl_fuzzy *fuzzy; /**@brief The same words, for a fuzzy completion */
+} cli_command_t;
+
+/** @brief Command, or word leading to commands, known at build time */
+typedef struct
+{
+	const char *path; /**@brief The words from the first one, separated by one space */
+	unsigned short parent; /**@brief Slot of the words before, CLI_COMMAND_HASH_NONE if none */
+	unsigned short word; /**@brief Offset of the last word in path */
+	unsigned short len; /**@brief Length of the last word */
+	cli_command_func_t *func; /**@brief Function to call, NULL for a word only leading to other commands */
+	const char *doc; /**@brief Command documentation */
+	bool args_path; /**@brief The arguments are the words of a command (e.g. help) */
+} cli_command_static_t;
+
+/* Generated by tools/cli_command_gen.c, in the order of the perfect hash */
+extern const unsigned cli_command_static_count;
+extern const unsigned cli_command_static_buckets;
+extern const unsigned cli_command_static_displacement[];
+extern const cli_command_static_t cli_command_static[];
+
+int cli_command_init(void);
+void cli_command_deinit(void);
+
+cli_command_t *cli_command_register(const char *path, cli_command_func_t *func, const char *doc);
+bool cli_command_add_argument(cli_command_t *command, tinyrl_provider_func_t *func, void *context, unsigned ttl);
+void cli_command_set_path_argument(cli_command_t *command);
+
+int cli_command_tokenize(char *line, cli_token_t *argv, int size);
+cli_command_t *cli_command_find(int argc, const cli_token_t *argv, int *used);
+bool cli_command_complete(tinyrl_t *t, bool allow_prefix, bool allow_empty, unsigned fuzzy);
+
+#endif /* CLI_COMMAND_H_ */
@@ -0,0 +1,71 @@
+/**
+ * @file cli_command_hash.h
+ * @brief Minimal perfect hash of the commands known at build time, computed
+ *        the same way by cli_command_gen and by the command lookup.
+ *
+ * The key is the words of a command separated by one space, hashed a word
+ * at a time so the words leading to a command are hashed on the way. The
+ * hash picks a bucket, whose displacement picks the slot of the key; the
+ * displacements are chosen by cli_command_gen so that no two keys share a
+ * slot and no slot is empty.
+ */
+
+#ifndef CLI_COMMAND_HASH_H_
+#define CLI_COMMAND_HASH_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** @brief Hash of no word */
+#define CLI_COMMAND_HASH_INIT 0xcbf29ce484222325ULL
+/** @brief Parent of the first word of a command */
+#define CLI_COMMAND_HASH_NONE 0xffff
+
+/**
+ * @brief  Hash one more word of a command
+ * @param  hash Hash of the words before
+ * @param  word Word, not null terminated
+ * @param  len Length of the word
+ * @param  first true for the first word of the command
+ * @return Hash of the words up to this one
+ **/
+static inline uint64_t cli_command_hash_word(uint64_t hash, const char *word, size_t len, bool first)
+{
+	size_t i;
+
+	if (!first)
+		hash = (hash ^ ' ') * 0x100000001b3ULL;
+	for (i = 0; i < len; i++)
+		hash = (hash ^ (unsigned char) word[i]) * 0x100000001b3ULL;
+	return hash;
+}
+
+/**
+ * @brief  Bucket of a key
+ * @param  hash Hash of the key
+ * @param  buckets Number of buckets
+ * @return Bucket, below buckets
+ **/
+static inline unsigned cli_command_hash_bucket(uint64_t hash, unsigned buckets)
+{
+	return ((hash >> 32) * buckets) >> 32;
+}
+
+/**
+ * @brief  Slot of a key
+ * @param  hash Hash of the key
+ * @param  displacement Displacement of the bucket of the key
+ * @param  count Number of slots
+ * @return Slot, below count
+ **/
+static inline unsigned cli_command_hash_slot(uint64_t hash, unsigned displacement, unsigned count)
+{
+	hash ^= displacement * 0x9e3779b97f4a7c15ULL;
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdULL;
+	hash ^= hash >> 33;
+	return ((hash & 0xffffffff) * count) >> 32;
+}
+
+#endif /* CLI_COMMAND_HASH_H_ */
@@ -3,6 +3,7 @@
 
 #include <main.h>
 
+void cli_prompt_set_fuzzy_completion(bool fuzzy);
 int cli_prompt_init();
 int cli_prompt_deinit();
 void *cli_prompt_thread(void* arg);
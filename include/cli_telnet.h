@@ -10,6 +10,9 @@
 
 #include <main.h>
 
+void cli_telnet_set_workers(unsigned count);
+void cli_telnet_set_shared_history(bool shared);
+void cli_telnet_set_fuzzy_completion(bool fuzzy);
 int cli_telnet_init();
 int cli_telnet_deinit();
 void *cli_telnet_thread(void* arg);
@@ -3,6 +3,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include <libgen.h>
 
 #include <pthread.h>
@@ -14,6 +15,7 @@
 #include <ctype.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
 #include <unistd.h>
 
 #include "cli_prompt.h"
@@ -22,6 +24,11 @@
 #include "tinyrl.h"
 #include "tinyrl_complete.h"
 #include "tinyrl_history.h"
+#include "tinyrl_radix.h"
+#include "tinyrl_fuzzy.h"
+#include "tinyrl_provider.h"
+
+#include "cli_command.h"
 
 /**
  * @brief The set of possible main app states.
@@ -12,9 +12,9 @@
 
 #include <stdbool.h>
 #include <stdio.h>
-#include <regex.h> // nao está no original
 #include <termios.h> // nao está no original
 #include <sys/socket.h> // nao está no original
+#include <sys/uio.h>
 
 /* Data passed to the threads we create */
 //struct thread_data {
@@ -23,6 +23,46 @@
 //    int new_fd;
 //};
 
+/**
+ * \return
+ * - true if the action associated with the key has
+ *   been performed successfully
+ * - false if the action was not successful
+ */
+typedef bool tinyrl_key_func_t(void * context, int key);
+
+/**
+ * Output function replacing the writes to the output stream descriptor of
+ * non-tty instances.
+ * \return the number of bytes taken or -1 on error
+ */
+typedef ssize_t tinyrl_write_func_t(void * context, const char *buf, size_t len);
+
+/**
+ * Output counters of a non-tty instance
+ */
+typedef struct {
+	unsigned long appends;	/* output fragments queued */
+	unsigned long flushes;	/* flushes with output pending */
+	unsigned long syscalls;	/* system calls made to write the output */
+	unsigned long bytes;	/* bytes written */
+} tinyrl_stats_t;
+
+/**
+ * Text displayed by the redisplay: the prompt followed by the line
+ */
+struct tinyrl_frame {
+	char *text;
+	size_t size;		/* bytes allocated for text */
+	unsigned len;		/* length of text */
+};
+
+/* storage for the line inside the instance, enough for most lines */
+#define TINYRL_INLINE_SIZE 128
+
+/* narrowest terminal width taken, in columns */
+#define TINYRL_MIN_WIDTH 20
+
 /* define the class member data and virtual methods */
 struct _tinyrl {
 	FILE *istream;
@@ -30,8 +70,12 @@ struct _tinyrl {
 	const char *line;
 	unsigned max_line_length;
 	const char *prompt;
-	char *buffer;
-	size_t buffer_size;
+	unsigned prompt_len;
+	char *buffer;		/* inline_buffer, or the heap once a line outgrows it */
+	size_t buffer_size;	/* capacity of buffer, without the terminator */
+	unsigned gap;		/* the text of buffer after this position is
+				   kept at its end, see tinyrl_gap_move() */
+	char inline_buffer[TINYRL_INLINE_SIZE];
 	bool done;
 	unsigned point;
 	unsigned end;
@@ -42,12 +86,30 @@ struct _tinyrl {
 	bool echo_enabled;
 	struct termios default_termios;
 	bool isatty;
-	char *last_buffer;	/* hold record of the previous
-				   buffer for redisplay purposes */
+	struct tinyrl_frame frame[2];	/* frame buffers, one holds what is
+				   on the screen and the other the next frame */
+	struct tinyrl_frame *last_frame;	/* hold record of the previous
+				   frame for redisplay purposes, NULL to start afresh */
 	unsigned last_point;	/* hold record of the previous
 				   cursor position for redisplay purposes */
+	unsigned last_width;	/* terminal width the previous
+				   buffer was displayed with */
+	unsigned width;		/* terminal width, 0 when unknown */
 	pthread_t thread_id;
 	int sock_fd;
+	struct tinyrl_keymap *seq_keymap;	/* keymap of a partially received
+				   key sequence, NULL when idle */
+	tinyrl_key_func_t *seq_handler;	/* best handler matched so far */
+	void *seq_context;
+	int seq_key;		/* first key of the sequence */
+	tinyrl_key_func_t *key_filter;	/* given each key before the keymap,
+				   NULL when no mode has taken over the keys */
+	void *key_filter_context;
+	tinyrl_write_func_t *write_func;	/* output of non-tty instances,
+				   NULL writes to the ostream descriptor */
+	void *write_context;
+	struct tinyrl_output *output;	/* queued output of non-tty instances */
+	struct tinyrl_input *input;	/* read ahead input of non-tty instances */
 };
 ////////////////////////////////
 
@@ -63,25 +125,72 @@ enum tinyrl_key {
 /* virtual methods */
 typedef int tinyrl_hook_func_t(tinyrl_t * instance);
 
-/**
- * \return
- * - true if the action associated with the key has
- *   been performed successfully
- * - false if the action was not successful
- */
-typedef bool tinyrl_key_func_t(void * context, int key);
-
 /* exported functions */
 extern tinyrl_t *tinyrl_new(FILE * instream,
 			    FILE * outstream);
 
 /*lint -esym(534,tinyrl_printf)  Ignoring return value of function */
-extern int tinyrl_printf(const tinyrl_t * instance, const char *fmt, ...);
+extern int tinyrl_printf(const tinyrl_t * instance, const char *fmt, ...)
+	__attribute__ ((format (printf, 2, 3)));
+
+/**
+ * Output len bytes of text as they are, without format processing. On
+ * non-tty instances the text is copied straight into the output queue.
+ */
+/*lint -esym(534,tinyrl_write)  Ignoring return value of function */
+extern int tinyrl_write(const tinyrl_t * instance, const char *text, size_t len);
 
 extern void tinyrl_delete(tinyrl_t * instance);
 
+/**
+ * The output of non-tty instances is queued and written with a single
+ * system call when the input given to tinyrl_feed() has been processed, or
+ * when a new line is started. Anything printed at other times (e.g. from a
+ * command handler run between lines) is sent by the next flush, which may
+ * also be requested explicitly.
+ * \return 0 if the queue has been written, TINYRL_FLUSH_PENDING if the
+ * output cannot take more for now (non blocking socket full, short write):
+ * the rest is kept and sent by a flush once the output is writable again,
+ * -1 on error (the queue is kept)
+ */
+#define TINYRL_FLUSH_PENDING 1
+extern int tinyrl_flush(const tinyrl_t * instance);
+
+/**
+ * Access to the output queue of a non-tty instance, for transports which
+ * send it asynchronously (e.g. io_uring) rather than from tinyrl_flush().
+ * tinyrl__output_peek() describes the start of the queue in up to count
+ * fragments, the queued blocks stay in place until tinyrl__output_consume()
+ * drops the len bytes sent from the start of the queue. Output queued in
+ * the meantime is added behind them.
+ * \return the number of fragments described in iov
+ */
+extern int tinyrl__output_peek(const tinyrl_t * instance, struct iovec *iov, int count);
+extern void tinyrl__output_consume(const tinyrl_t * instance, size_t len);
+
+/**
+ * Output counters, to compare the number of system calls with the number
+ * of fragments printed.
+ */
+extern const tinyrl_stats_t *tinyrl__get_stats(const tinyrl_t * instance);
+
 extern const char *tinyrl__get_prompt(const tinyrl_t * instance);
 
+/**
+ * Change the prompt of the line being read, from the next redisplay on. The
+ * prompt must stay valid while it is shown.
+ */
+extern void tinyrl__set_prompt(tinyrl_t * instance, const char *prompt);
+
+/**
+ * Give each key to filter before looking it up in the keymap, for modes
+ * which take over the keyboard (e.g. the history search). The key is
+ * handled as usual when the filter returns false. A NULL filter ends the
+ * mode, as does the start of a new line.
+ */
+extern void tinyrl__set_key_filter(tinyrl_t * instance, tinyrl_key_func_t *filter,
+				   void *context);
+
 extern void tinyrl_done(tinyrl_t * instance);
 
 /**
@@ -95,10 +204,28 @@ extern unsigned tinyrl__get_point(const tinyrl_t * instance);
 
 extern unsigned tinyrl__get_end(const tinyrl_t * instance);
 
+/**
+ * Terminal width in columns: the width given to tinyrl__set_width(), else
+ * the size of a tty output or 80.
+ */
 extern unsigned tinyrl__get_width(const tinyrl_t * instance);
 
+/**
+ * Set the terminal width of an instance whose output is not a tty (e.g.
+ * as reported by the telnet client), 0 to go back to the default. Widths
+ * under TINYRL_MIN_WIDTH are taken as TINYRL_MIN_WIDTH.
+ */
+extern void tinyrl__set_width(tinyrl_t * instance, unsigned width);
+
 extern void tinyrl__set_istream(tinyrl_t * instance, FILE * istream);
 
+/**
+ * Route the output of a non-tty instance through func instead of writing
+ * to the output stream descriptor. A NULL func restores the default.
+ */
+extern void tinyrl__set_output(tinyrl_t * instance, tinyrl_write_func_t *func,
+			       void *context);
+
 extern bool tinyrl__get_isatty(const tinyrl_t * instance);
 
 extern FILE *tinyrl__get_istream(const tinyrl_t * instance);
@@ -107,6 +234,27 @@ extern FILE *tinyrl__get_ostream(const tinyrl_t * instance);
 
 char * tinyrl_readline(tinyrl_t * instance, const char *prompt);
 
+/**
+ * Push based counterpart of tinyrl_readline(), for callers which own the
+ * input (event loops, test harnesses).
+ *
+ * tinyrl_readline_begin() starts a new line and displays the prompt. Input
+ * bytes are then handed to tinyrl_feed() as they arrive; key sequences may
+ * be split across calls, the partial state is kept in the instance. Once
+ * TINYRL_FEED_LINE is returned tinyrl_readline_end() gives the line (to be
+ * freed by the caller) and the next line is started with
+ * tinyrl_readline_begin(). Bytes after the end of the line are not consumed.
+ */
+typedef enum {
+	TINYRL_FEED_MORE,	/* the line is not complete, feed more input */
+	TINYRL_FEED_LINE	/* a complete line is available */
+} tinyrl_feed_t;
+
+extern void tinyrl_readline_begin(tinyrl_t * instance, const char *prompt);
+extern tinyrl_feed_t tinyrl_feed(tinyrl_t * instance, const char *bytes,
+				 size_t len, size_t *consumed);
+extern char *tinyrl_readline_end(tinyrl_t * instance);
+
 void tinyrl_bind_key(tinyrl_t * instance, unsigned char key,
 		     tinyrl_key_func_t *handler, void *context);
 void tinyrl_bind_special(tinyrl_t * instance, enum tinyrl_key key,
@@ -172,6 +320,7 @@ extern void tinyrl_limit_line_length(
 /* External functions (from tinyrl_history) to provide navigation through the history of commands */
 extern bool tinyrl_history_key_up(void *context, int key);
 extern bool tinyrl_history_key_down(void *context, int key);
+extern bool tinyrl_history_key_search(void *context, int key);
 
 #endif				/* _tinyrl_tinyrl_h */
 /** @} tinyrl_tinyrl */
@@ -2,10 +2,54 @@
 #define _tinyrl_complete_h
 
 #include "tinyrl.h"
+#include "tinyrl_radix.h"
+#include "tinyrl_fuzzy.h"
+#include "tinyrl_provider.h"
+
+/* bytes of each block of the arena the copied matches are kept in */
+#define TINYRL_MATCHES_BLOCK 4096
+
+/**
+ * Set of completion matches for the word being completed. The matches are
+ * either borrowed from the caller or copied into an arena, the count and
+ * the prefix they share are kept up to date as they are added, and the
+ * whole set is released at once by tinyrl_matches_release().
+ */
+struct tinyrl_matches {
+	char **match;		/* NULL terminated, NULL while the set is empty */
+	unsigned count;
+	unsigned size;		/* slots allocated in match */
+	const char *word;	/* the word being completed, in the line */
+	unsigned word_len;
+	unsigned common;	/* length of the prefix shared by the matches */
+	bool complete;		/* the shared prefix is one of the matches */
+	struct tinyrl_matches_block *arena;	/* block copies are made in */
+	size_t arena_used;	/* bytes taken in the current block */
+};
+
+/**
+ * Start an empty set for the word from start to the cursor. The line must
+ * not change until the set is released.
+ */
+void tinyrl_matches_init(
+	struct tinyrl_matches *matches, const tinyrl_t *this, unsigned start);
+
+/**
+ * Add a match, which must stay valid until the set is released. Words not
+ * starting with the word being completed are ignored.
+ * \return false if there is no memory
+ */
+bool tinyrl_matches_add(struct tinyrl_matches *matches, const char *match);
+
+/**
+ * Add a copy of the len first bytes of match, for words which do not
+ * outlive the call (e.g. built in a local buffer).
+ */
+bool tinyrl_matches_add_copy(
+	struct tinyrl_matches *matches, const char *match, size_t len);
+
+void tinyrl_matches_release(struct tinyrl_matches *matches);
 
-char **tinyrl_add_match(
-	const tinyrl_t *this, unsigned start, char **matches, const char *match);
-void tinyrl_delete_matches(char **matches);
 void tinyrl_display_matches(const tinyrl_t * this, char *const *matches);
 
 /**
@@ -22,6 +66,34 @@ void tinyrl_display_matches(const tinyrl_t * this, char *const *matches);
  * the buffer then the matches are displayed.
  */
 bool tinyrl_complete(
-	tinyrl_t *this, unsigned start, char **matches, bool allow_prefix);
+	tinyrl_t *this, unsigned start, const struct tinyrl_matches *matches,
+	bool allow_prefix);
+
+/**
+ * Complete the current word with the words of a radix tree, as
+ * tinyrl_complete() does with a set of matches. The common prefix comes
+ * from the tree, the matches are only listed when they are displayed.
+ */
+bool tinyrl_complete_radix(
+	tinyrl_t *this, unsigned start, const struct tinyrl_radix *radix,
+	bool allow_prefix);
+
+/**
+ * Complete the current word with the words of a fuzzy set, for when no
+ * word starts with it. A single match replaces the word and the result is
+ * true, otherwise the k best matches are displayed, the best first.
+ */
+bool tinyrl_complete_fuzzy(
+	tinyrl_t *this, unsigned start, const struct tinyrl_fuzzy *fuzzy,
+	unsigned k);
+
+/**
+ * Complete the current word with the values of a provider, as
+ * tinyrl_complete_radix() does. The values at hand are used, nothing is
+ * completed until they have been fetched once.
+ */
+bool tinyrl_complete_provider(
+	tinyrl_t *this, unsigned start, struct tinyrl_provider *provider,
+	bool allow_prefix);
 
 #endif
@@ -0,0 +1,61 @@
+/**
+  \ingroup tinyrl
+  \defgroup tinyrl_fuzzy fuzzy
+  @{
+
+  \brief This class ranks a large set of words (e.g. object names) by how
+  well they match a fragment typed by the user, for completion when no word
+  starts with it.
+
+  A word matches when the characters of the fragment appear in it in the
+  same order, ignoring case. Each matched character scores, more so when it
+  follows the previous one or starts a word part (after a character which
+  is neither a letter nor a digit); the characters skipped cost a little.
+
+  The words are kept lowercased in 32 byte slots, together with a bitmap of
+  the characters they hold. A ranking first drops the words missing some
+  character of the fragment by comparing the bitmaps, then finds the
+  characters in the slots of the others with vector compares (AVX2 or SSE2,
+  chosen at run time), words longer than a slot being matched byte by byte.
+
+*/
+#ifndef _tinyrl_fuzzy_h
+#define _tinyrl_fuzzy_h
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct tinyrl_fuzzy;
+
+extern struct tinyrl_fuzzy *tinyrl_fuzzy_new(void);
+extern void tinyrl_fuzzy_delete(struct tinyrl_fuzzy *fuzzy);
+
+/**
+ * Add a word, which must stay valid while it is in the set. Words may not
+ * be added while the set is being ranked, rankings may run concurrently.
+ * \return false if there is no memory
+ */
+extern bool tinyrl_fuzzy_add(struct tinyrl_fuzzy *fuzzy, const char *word);
+
+extern unsigned tinyrl_fuzzy_count(const struct tinyrl_fuzzy *fuzzy);
+
+/**
+ * Find the k words best matching the len first bytes of fragment. best is
+ * filled with them, the best first; ties go to the shorter word, then to
+ * the word added first.
+ * \return the number of words put in best, at most k
+ */
+extern unsigned tinyrl_fuzzy_rank(const struct tinyrl_fuzzy *fuzzy,
+				  const char *fragment, size_t len,
+				  const char **best, unsigned k);
+
+/**
+ * Score of word for the len first bytes of fragment, as used by the
+ * ranking.
+ * \return -1 if the word does not match
+ */
+extern int tinyrl_fuzzy_score(const char *word, const char *fragment,
+			      size_t len);
+
+#endif				/* _tinyrl_fuzzy_h */
+/** @} tinyrl_fuzzy */
@@ -20,6 +20,12 @@
 struct tinyrl_history *tinyrl_history_new(tinyrl_t *tinyrl, unsigned limit);
 
 extern void tinyrl_history_delete(struct tinyrl_history *history);
+/**
+ * Copy of a history, not bound to any instance, made with a couple of
+ * block copies. Released with tinyrl_history_delete().
+ */
+extern struct tinyrl_history *tinyrl_history_snapshot(
+	const struct tinyrl_history *history);
 extern void tinyrl_history_add(struct tinyrl_history *history, const char *line);
 
 /*
@@ -33,8 +39,50 @@ extern const char *tinyrl_history_get(const struct tinyrl_history *history,
 				      unsigned offset);
 extern size_t tinyrl_history_length(const struct tinyrl_history *history);
 
+/*
+   HISTORY FILE
+   */
+/**
+ * Load the entries of a history file, created if needed, and append the
+ * entries added from now on to it. The history must still be empty. The
+ * entries are read from the file mapped in memory, not copied; removing or
+ * clearing entries does not change the file.
+ * \return false if the file cannot be used, the history then stays in memory
+ */
+extern bool tinyrl_history_open(struct tinyrl_history *history, const char *path);
+
+/*
+   SHARED HISTORY
+   */
+/**
+ * History shared by instances which may run on different threads. Adding
+ * an entry never waits: a slot of a ring of size entries is reserved with
+ * an atomic increment and the line is written in place. Lines of 248 bytes
+ * or more are not shared.
+ */
+struct tinyrl_history_shared;
+
+extern struct tinyrl_history_shared *tinyrl_history_shared_new(unsigned size);
+extern void tinyrl_history_shared_delete(struct tinyrl_history_shared *shared);
+extern void tinyrl_history_shared_add(struct tinyrl_history_shared *shared,
+				      const char *line);
+/**
+ * Make history a view of shared: the lines given to tinyrl_history_add()
+ * go to shared, and the history takes the new entries of shared each time
+ * the user starts going through it (up key or search). It is then a stable
+ * snapshot until the line is done. NULL detaches the history.
+ */
+extern void tinyrl_history_share(struct tinyrl_history *history,
+				 struct tinyrl_history_shared *shared);
+
 extern bool tinyrl_history_key_up(void *context, int key);
 extern bool tinyrl_history_key_down(void *context, int key);
+/**
+ * Start an incremental reverse search, bound to ctrl-R. The entries are
+ * looked up in a trigram index, built by the first search over a large
+ * history and then kept up to date by tinyrl_history_add().
+ */
+extern bool tinyrl_history_key_search(void *context, int key);
 
 #endif				/* _tinyrl_history_h */
 /** @} tinyrl_history */
@@ -0,0 +1,73 @@
+/**
+  \ingroup tinyrl
+  \defgroup tinyrl_history_file history_file
+  @{
+
+  \brief This class keeps a history on disk, in an append only file which is
+  mapped in memory when it is opened.
+
+  The history is made of two files. The data file holds the entries as null
+  terminated strings, one after the other. The index file holds the offset
+  of each entry in the data file as a 64 bit integer. Both start with a 16
+  byte header: a magic string and a generation number, changed each time
+  the files are compacted. Opening a history maps both files, so no entry is
+  read or parsed. The index is only rebuilt from the data file if it does
+  not match it (e.g. after a crash).
+
+  Once the file holds twice as many entries as the history keeps, the
+  entries which are no longer needed are dropped by a background thread
+  writing new files, which then replace the old ones.
+
+*/
+#ifndef _tinyrl_history_file_h
+#define _tinyrl_history_file_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The entries of a history file at the time it was opened, shared by the
+ * histories and snapshots using them.
+ */
+struct tinyrl_history_map {
+	unsigned refs;
+	const char *text;	/* the data file */
+	size_t text_size;
+	const uint64_t *offsets;	/* offset in text of each entry */
+	unsigned length;	/* number of entries */
+	void *index;		/* the index file mapped, NULL if rebuilt */
+	size_t index_size;
+};
+
+struct tinyrl_history_file;
+
+/**
+ * Open or create a history file. The entries it holds are returned in map.
+ * The file is locked until it is closed, another process cannot open it.
+ * \return NULL if the file cannot be used
+ */
+extern struct tinyrl_history_file *tinyrl_history_file_open(const char *path,
+	struct tinyrl_history_map **map);
+
+/**
+ * Append an entry of len bytes, the null included. Once the file holds
+ * twice keep entries a compaction keeping the last keep entries is started,
+ * 0 keeps all of them.
+ */
+extern void tinyrl_history_file_append(struct tinyrl_history_file *file,
+	const char *line, size_t len, unsigned keep);
+
+extern void tinyrl_history_file_sync(struct tinyrl_history_file *file);
+
+/**
+ * Wait for a compaction in progress, write everything to disk and close.
+ */
+extern void tinyrl_history_file_close(struct tinyrl_history_file *file);
+
+extern struct tinyrl_history_map *tinyrl_history_map_ref(
+	struct tinyrl_history_map *map);
+extern void tinyrl_history_map_unref(struct tinyrl_history_map *map);
+
+#endif				/* _tinyrl_history_file_h */
+/** @} tinyrl_history_file */
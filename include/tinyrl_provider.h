@@ -0,0 +1,69 @@
+/**
+  \ingroup tinyrl
+  \defgroup tinyrl_provider provider
+  @{
+
+  \brief This class caches the values an argument may take (e.g. interface
+  names), as given by a function which may take its time to get them.
+
+  The values are fetched by a background thread, and kept in a radix tree
+  for the time to live of the provider. A completion uses the values at
+  hand, starting a new fetch in the background when they have expired: it
+  never waits for the function, the values are only missing until the
+  first fetch is over. Several sessions may complete with a provider at the
+  same time.
+
+*/
+#ifndef _tinyrl_provider_h
+#define _tinyrl_provider_h
+
+#include <stdbool.h>
+
+#include "tinyrl_radix.h"
+
+/**
+ * Fetch the values, inserting them in values. Runs in a background thread,
+ * it may block.
+ * \return false if the values could not be fetched, those at hand are kept
+ */
+typedef bool tinyrl_provider_func_t(void *context, struct tinyrl_radix *values);
+
+struct tinyrl_provider;
+
+/**
+ * Values fetched by a provider, held until released
+ */
+struct tinyrl_provider_values {
+	unsigned refs;
+	struct tinyrl_radix *radix;
+};
+
+/**
+ * \param ttl milliseconds the values are used for before they are fetched
+ * again, 0 to fetch them once
+ */
+extern struct tinyrl_provider *tinyrl_provider_new(tinyrl_provider_func_t *func,
+						   void *context, unsigned ttl);
+
+/**
+ * Wait for a fetch in progress, then free the provider.
+ */
+extern void tinyrl_provider_delete(struct tinyrl_provider *provider);
+
+/**
+ * Start fetching the values in the background unless a fetch is already in
+ * progress, e.g. to have them before the first completion.
+ */
+extern void tinyrl_provider_refresh(struct tinyrl_provider *provider);
+
+/**
+ * The values at hand, a fetch being started if they have expired.
+ * \return NULL until the values have been fetched once
+ */
+extern struct tinyrl_provider_values *tinyrl_provider_get(
+	struct tinyrl_provider *provider);
+
+extern void tinyrl_provider_release(struct tinyrl_provider_values *values);
+
+#endif				/* _tinyrl_provider_h */
+/** @} tinyrl_provider */
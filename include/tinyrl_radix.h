@@ -0,0 +1,74 @@
+/**
+  \ingroup tinyrl
+  \defgroup tinyrl_radix radix
+  @{
+
+  \brief This class indexes a set of words (e.g. command names) in a radix
+  tree, for lookups and completion in the time of the length of the word
+  rather than of the number of words.
+
+  Each node of the tree counts the words below it, so the number of words
+  starting with a prefix, and the longest prefix they share, are known once
+  the prefix has been followed down the tree.
+
+*/
+#ifndef _tinyrl_radix_h
+#define _tinyrl_radix_h
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct tinyrl_radix;
+
+/**
+ * Words starting with a given prefix
+ */
+struct tinyrl_radix_range {
+	unsigned count;		/* number of words */
+	const char *word;	/* one of them, NULL if there is none */
+	size_t common;		/* length of the prefix they all share */
+	bool complete;		/* the shared prefix is a word itself */
+};
+
+/**
+ * Called for each word of a walk, in alphabetical order.
+ * \return false to stop the walk
+ */
+typedef bool tinyrl_radix_func_t(void *context, const char *word, void *value);
+
+extern struct tinyrl_radix *tinyrl_radix_new(void);
+extern void tinyrl_radix_delete(struct tinyrl_radix *radix);
+
+/**
+ * Add a word, or change the value of a word already there. The word is
+ * copied.
+ * \return false if there is no memory
+ */
+extern bool tinyrl_radix_insert(struct tinyrl_radix *radix, const char *word,
+				void *value);
+
+/**
+ * Look up the words starting with the len first bytes of prefix.
+ */
+extern void tinyrl_radix_prefix(const struct tinyrl_radix *radix,
+				const char *prefix, size_t len,
+				struct tinyrl_radix_range *range);
+
+/**
+ * Find the value of the word made of the len first bytes of word, or else
+ * of the only word it is a prefix of. count is set to the number of words
+ * it is a prefix of (the word itself included).
+ * \return NULL if there is no such word or it is ambiguous
+ */
+extern void *tinyrl_radix_match(const struct tinyrl_radix *radix,
+				const char *word, size_t len, unsigned *count);
+
+/**
+ * Call func for each word starting with the len first bytes of prefix.
+ */
+extern void tinyrl_radix_walk(const struct tinyrl_radix *radix,
+			      const char *prefix, size_t len,
+			      tinyrl_radix_func_t *func, void *context);
+
+#endif				/* _tinyrl_radix_h */
+/** @} tinyrl_radix */
@@ -0,0 +1,618 @@
+/**
+ * @file cli_command.c
+ * @brief Registry of the commands, shared by the CLI over the tty and over
+ *        telnet
+ */
+
+#include "cli_command.h"
+
+/** @brief Commands printed on a line of the help */
+#define CLI_COMMAND_HELP_COLUMNS 6
+
+/** @brief Root of the tree, its children are the first words of the commands */
+static cli_command_t cli_command_root;
+/** @brief Taken for writing by the registrations, for reading by the lookups */
+static pthread_rwlock_t cli_command_lock = PTHREAD_RWLOCK_INITIALIZER;
+/** @brief Command of each slot of cli_command_static[], made by cli_command_init() */
+static cli_command_t **cli_command_static_node;
+
+/* Functions for the commands of cli_command_table.def */
+void cli_command_help(tinyrl_t *this, int argc, const cli_token_t *argv);
+void cli_command_quit(tinyrl_t *this, int argc, const cli_token_t *argv);
+
+/**
+ * @brief  Find the word following a command, abbreviated as long as the
+ *         abbreviation is unique
+ * @param  command Command the word follows
+ * @param  word Word, not null terminated
+ * @param  len Length of the word
+ * @return Command of the word or NULL if not found
+ **/
+static cli_command_t *cli_command_child(const cli_command_t *command, const char *word, size_t len)
+{
+	unsigned count;
+
+	if (!command->children || !len)
+		return NULL;
+	return tinyrl_radix_match(command->children, word, len, &count);
+}
+
+/**
+ * @brief  Follow the words of a line through the commands known at build
+ *         time, as far as they are typed in full
+ * @param  argc Number of words
+ * @param  argv Words of the line
+ * @param  used Set to the number of words naming the command found
+ * @return Last command found, the root if the first word is not one
+ **/
+static cli_command_t *cli_command_lookup_static(int argc, const cli_token_t *argv, int *used)
+{
+	cli_command_t *command = &cli_command_root;
+	const cli_command_static_t *entry;
+	unsigned parent = CLI_COMMAND_HASH_NONE;
+	unsigned slot;
+	uint64_t hash = CLI_COMMAND_HASH_INIT;
+	int i;
+
+	/* without the commands of the table the tree has them all */
+	if (!cli_command_static_node)
+	{
+		*used = 0;
+		return command;
+	}
+
+	for (i = 0; i < argc; i++)
+	{
+		/* a slot holds the words hashed to it, or other words */
+		hash = cli_command_hash_word(hash, argv[i].s, argv[i].len, parent == CLI_COMMAND_HASH_NONE);
+		slot = cli_command_static_displacement[cli_command_hash_bucket(hash, cli_command_static_buckets)];
+		slot = cli_command_hash_slot(hash, slot, cli_command_static_count);
+		entry = &cli_command_static[slot];
+		if (entry->parent != parent || entry->len != argv[i].len
+		    || memcmp(entry->path + entry->word, argv[i].s, argv[i].len))
+			break;
+		if (!cli_command_static_node[slot])
+			break;
+
+		command = cli_command_static_node[slot];
+		parent = slot;
+	}
+	*used = i;
+	return command;
+}
+
+/**
+ * @brief  Follow the words of a line down the tree, as far as they are
+ *         commands
+ * @param  command Command the words follow
+ * @param  argc Number of words
+ * @param  argv Words of the line
+ * @param  used Set to the number of words naming the command found
+ * @return Last command found, command if the first word is not one
+ **/
+static cli_command_t *cli_command_lookup(cli_command_t *command, int argc, const cli_token_t *argv, int *used)
+{
+	cli_command_t *child;
+	int i;
+
+	for (i = 0; i < argc; i++)
+	{
+		child = cli_command_child(command, argv[i].s, argv[i].len);
+		if (!child)
+			break;
+		command = child;
+	}
+	*used = i;
+	return command;
+}
+
+/**
+ * @brief  Add the word following a command, or find it if already there
+ * @param  parent Command the word follows
+ * @param  word Word, not null terminated
+ * @param  len Length of the word
+ * @return Command of the word or NULL if there is no memory
+ **/
+static cli_command_t *cli_command_add_child(cli_command_t *parent, const char *word, size_t len)
+{
+	cli_command_t *command;
+	size_t path_len;
+
+	/* an abbreviation of an existing word is a new word */
+	command = cli_command_child(parent, word, len);
+	if (command && strlen(command->name) == len)
+		return command;
+
+	if (!parent->children)
+	{
+		parent->children = tinyrl_radix_new();
+		parent->fuzzy = tinyrl_fuzzy_new();
+		if (!parent->children || !parent->fuzzy)
+			return NULL;
+	}
+
+	command = calloc(1, sizeof(*command));
+	if (!command)
+		return NULL;
+	command->name = strndup(word, len);
+	path_len = parent->path ? strlen(parent->path) + 1 : 0;
+	command->path = malloc(path_len + len + 1);
+	if (!command->name || !command->path)
+		goto fail;
+	if (parent->path)
+	{
+		memcpy(command->path, parent->path, path_len - 1);
+		command->path[path_len - 1] = ' ';
+	}
+	memcpy(command->path + path_len, word, len);
+	command->path[path_len + len] = '\0';
+
+	if (!tinyrl_radix_insert(parent->children, command->name, command))
+		goto fail;
+	/* the radix tree is what finds the word, the fuzzy set only ranks it */
+	tinyrl_fuzzy_add(parent->fuzzy, command->name);
+	return command;
+
+fail:
+	free(command->name);
+	free(command->path);
+	free(command);
+	return NULL;
+}
+
+/**
+ * @brief  Free the commands following a command, called for each of them
+ * @param  context Unused
+ * @param  word Word of the command
+ * @param  value Command
+ * @return true to go on with the next one
+ **/
+static bool cli_command_free(void *context, const char *word, void *value)
+{
+	cli_command_t *command = value;
+	unsigned i;
+
+	if (command->children)
+		tinyrl_radix_walk(command->children, "", 0, cli_command_free, NULL);
+	tinyrl_radix_delete(command->children);
+	tinyrl_fuzzy_delete(command->fuzzy);
+	for (i = 0; i < command->args_count; i++)
+		tinyrl_provider_delete(command->args[i].provider);
+	free(command->args);
+	free(command->doc);
+	free(command->name);
+	free(command->path);
+	free(command);
+	return true;
+}
+
+/**
+ * @brief  Register the commands of cli_command_table.def
+ * @return 0 Success
+ */
+int cli_command_init(void)
+{
+	const cli_command_static_t *entry;
+	cli_command_t *command;
+	cli_command_t **nodes;
+	unsigned i;
+
+	nodes = calloc(cli_command_static_count + 1, sizeof(*nodes));
+	if (!nodes)
+	{
+		fprintf(stdout, "Fail registering commands.");
+		return ENOMEM;
+	}
+
+	for (i = 0; i < cli_command_static_count; i++)
+	{
+		entry = &cli_command_static[i];
+		command = cli_command_register(entry->path, entry->func, entry->doc);
+		if (!command)
+		{
+			/* drop the commands registered so far */
+			fprintf(stdout, "Fail registering commands.");
+			free(nodes);
+			cli_command_deinit();
+			return ENOMEM;
+		}
+		if (entry->args_path)
+			cli_command_set_path_argument(command);
+		nodes[i] = command;
+	}
+
+	/* the table is only used by the lookups once it is complete */
+	pthread_rwlock_wrlock(&cli_command_lock);
+	cli_command_static_node = nodes;
+	pthread_rwlock_unlock(&cli_command_lock);
+	return 0;
+}
+
+/**
+ * @brief  Remove all the commands. The CLIs must be stopped
+ * @return void
+ */
+void cli_command_deinit(void)
+{
+	pthread_rwlock_wrlock(&cli_command_lock);
+	if (cli_command_root.children)
+		tinyrl_radix_walk(cli_command_root.children, "", 0, cli_command_free, NULL);
+	tinyrl_radix_delete(cli_command_root.children);
+	tinyrl_fuzzy_delete(cli_command_root.fuzzy);
+	cli_command_root.children = NULL;
+	cli_command_root.fuzzy = NULL;
+	free(cli_command_static_node);
+	cli_command_static_node = NULL;
+	pthread_rwlock_unlock(&cli_command_lock);
+}
+
+/**
+ * @brief  Register a command, the words leading to it being added as
+ *         needed. A command registered again takes the new function
+ * @param  path Words of the command, separated by spaces
+ * @param  func Function to call
+ * @param  doc Command documentation, copied
+ * @return Command or NULL if there is no memory or no word
+ **/
+cli_command_t *cli_command_register(const char *path, cli_command_func_t *func, const char *doc)
+{
+	cli_command_t *command = &cli_command_root;
+	const char *end;
+	char *copy;
+
+	pthread_rwlock_wrlock(&cli_command_lock);
+	for (;;)
+	{
+		while (isspace(*path))
+			path++;
+		if (!*path)
+			break;
+		for (end = path; *end && !isspace(*end); end++)
+			;
+		command = cli_command_add_child(command, path, end - path);
+		if (!command)
+			break;
+		path = end;
+	}
+	if (command == &cli_command_root)
+		command = NULL;
+	if (command)
+	{
+		copy = strdup(doc ? doc : "");
+		if (copy)
+		{
+			free(command->doc);
+			command->doc = copy;
+			command->func = func;
+		}
+		else
+			command = NULL;
+	}
+	pthread_rwlock_unlock(&cli_command_lock);
+	return command;
+}
+
+/**
+ * @brief  Add an argument to a command, after those it already has. Its
+ *         values start being fetched in the background
+ * @param  command Command taking the argument
+ * @param  func Fetches the values
+ * @param  context Passed to func
+ * @param  ttl Milliseconds the values are used for, 0 for ever
+ * @return true if success
+ **/
+bool cli_command_add_argument(cli_command_t *command, tinyrl_provider_func_t *func, void *context, unsigned ttl)
+{
+	cli_argument_t *args;
+	struct tinyrl_provider *provider;
+
+	provider = tinyrl_provider_new(func, context, ttl);
+	if (!provider)
+		return false;
+
+	pthread_rwlock_wrlock(&cli_command_lock);
+	args = realloc(command->args, (command->args_count + 1) * sizeof(*args));
+	if (args)
+	{
+		command->args = args;
+		args[command->args_count].func = func;
+		args[command->args_count].provider = provider;
+		command->args_count++;
+	}
+	pthread_rwlock_unlock(&cli_command_lock);
+
+	if (!args)
+	{
+		tinyrl_provider_delete(provider);
+		return false;
+	}
+	tinyrl_provider_refresh(provider);
+	return true;
+}
+
+/**
+ * @brief  Complete the arguments of a command as the words of a command,
+ *         e.g. for help
+ * @param  command Command taking the words
+ * @return void
+ **/
+void cli_command_set_path_argument(cli_command_t *command)
+{
+	pthread_rwlock_wrlock(&cli_command_lock);
+	command->args_path = true;
+	pthread_rwlock_unlock(&cli_command_lock);
+}
+
+/**
+ * @brief  Split a line into words, in a single pass and in place: the words
+ *         are separated by spaces or tabs, a backslash escapes the character
+ *         after it, and quotes keep spaces in a word, a backslash escaping
+ *         in double quotes only. The quotes and escapes are removed and
+ *         each word is null terminated, so the line is overwritten
+ * @param  line Command line
+ * @param  argv Set to the words, pointing into line
+ * @param  size Number of words argv holds
+ * @return Number of words, -EINVAL if a quote is not closed, -E2BIG if there
+ *         are more than size words
+ **/
+int cli_command_tokenize(char *line, cli_token_t *argv, int size)
+{
+	const char *r = line;
+	char *w = line;
+	char *word;
+	char quote;
+	int argc = 0;
+
+	for (;;)
+	{
+		while (*r == ' ' || *r == '\t')
+			r++;
+		if (!*r)
+			return argc;
+		if (argc == size)
+			return -E2BIG;
+
+		/* the word is written back over itself, never longer than read */
+		word = w;
+		quote = 0;
+		for (; *r; r++)
+		{
+			if (quote == '\'' && *r != '\'')
+				*w++ = *r;
+			else if (*r == '\\' && r[1])
+				*w++ = *++r;
+			else if (quote && *r == quote)
+				quote = 0;
+			else if (quote)
+				*w++ = *r;
+			else if (*r == '\'' || *r == '"')
+				quote = *r;
+			else if (*r == ' ' || *r == '\t')
+				break;
+			else
+				*w++ = *r;
+		}
+		if (quote)
+			return -EINVAL;
+
+		argv[argc].s = word;
+		argv[argc].len = w - word;
+		argc++;
+		if (*r)
+			r++;
+		*w++ = '\0';
+	}
+}
+
+/**
+ * @brief  Find the command the first words of a line name. Each word may be
+ *         abbreviated as long as the abbreviation is unique
+ * @param  argc Number of words
+ * @param  argv Words of the line, see cli_command_tokenize()
+ * @param  used Set to the number of words naming the command, its arguments
+ *         following, or to the number of words found if there is none
+ * @return Command or NULL if the words name no command
+ **/
+cli_command_t *cli_command_find(int argc, const cli_token_t *argv, int *used)
+{
+	cli_command_t *command;
+	int rest;
+
+	pthread_rwlock_rdlock(&cli_command_lock);
+	/* the words typed in full are hashed, abbreviations and the commands
+	   registered at run time are found in the tree */
+	command = cli_command_lookup_static(argc, argv, used);
+	command = cli_command_lookup(command, argc - *used, argv + *used, &rest);
+	*used += rest;
+	pthread_rwlock_unlock(&cli_command_lock);
+
+	/* commands are only freed by cli_command_deinit() */
+	if (command == &cli_command_root || !command->func)
+		return NULL;
+	return command;
+}
+
+/**
+ * @brief  Complete the word at the cursor. The words of a command complete
+ *         with the words following the previous one, the arguments with
+ *         their values
+ * @param  t Line being completed
+ * @param  allow_prefix true if a word may be completed to a word it is the
+ *         prefix of, and an argument takes any value
+ * @param  allow_empty true if an empty word is complete
+ * @param  fuzzy Commands displayed when no command starts with the word,
+ *         0 for none
+ * @return true if the word is complete
+ **/
+bool cli_command_complete(tinyrl_t *t, bool allow_prefix, bool allow_empty, unsigned fuzzy)
+{
+	cli_command_t *command, *child;
+	const char *text;
+	unsigned start, end, i, j;
+	unsigned argc = 0;
+	bool path = false;
+	bool ret;
+
+	/* find the start of the current word */
+	text = tinyrl__get_line(t);
+	start = end = tinyrl__get_point(t);
+	while (start && !isspace(text[start - 1]))
+		start--;
+	if (start == end && allow_empty)
+		return true;
+
+	pthread_rwlock_rdlock(&cli_command_lock);
+
+	/* follow the words before the current one down the tree, those after
+	   the command are its arguments */
+	command = &cli_command_root;
+	for (i = 0;; i = j)
+	{
+		while (i < start && isspace(text[i]))
+			i++;
+		if (i == start)
+			break;
+		for (j = i; j < start && !isspace(text[j]); j++)
+			;
+		child = argc ? NULL : cli_command_child(command, text + i, j - i);
+		if (child)
+		{
+			command = child;
+			if (command->args_path)
+			{
+				command = &cli_command_root;
+				path = true;
+			}
+			continue;
+		}
+		/* no such command, any word is taken after it */
+		if (path || command == &cli_command_root)
+		{
+			ret = allow_prefix;
+			goto out;
+		}
+		argc++;
+	}
+
+	if (!argc && command->children && !(path && allow_prefix))
+	{
+		struct tinyrl_radix_range range;
+
+		tinyrl_radix_prefix(command->children, text + start, end - start, &range);
+		if (range.count || path || !command->args_count)
+		{
+			/* rank the commands holding the word when none starts with it */
+			if (!range.count && fuzzy)
+				ret = tinyrl_complete_fuzzy(t, start, command->fuzzy, fuzzy);
+			else
+				ret = tinyrl_complete_radix(t, start, command->children, allow_prefix);
+			goto out;
+		}
+	}
+
+	/* an argument takes any value, TAB completes the values known */
+	if (allow_prefix)
+		ret = true;
+	else if (!path && argc < command->args_count)
+		ret = tinyrl_complete_provider(t, start, command->args[argc].provider, false);
+	else
+		ret = false;
+
+out:
+	pthread_rwlock_unlock(&cli_command_lock);
+	return ret;
+}
+
+/**
+ * @brief  Print a command and those following it, called for each of them
+ * @param  context Line the commands are printed on
+ * @param  word Word of the command
+ * @param  value Command
+ * @return true to go on with the next one
+ **/
+static bool cli_command_print(void *context, const char *word, void *value)
+{
+	cli_command_t *command = value;
+
+	if (command->func)
+		tinyrl_printf(context, "%s\t\t%s.\n\r", command->path, command->doc);
+	if (command->children)
+		tinyrl_radix_walk(command->children, "", 0, cli_command_print, context);
+	return true;
+}
+
+/** @brief Names of the commands being printed in columns */
+typedef struct
+{
+	tinyrl_t *this; /**@brief Line the names are printed on */
+	unsigned printed; /**@brief Names on the current line */
+} cli_command_columns_t;
+
+/**
+ * @brief  Print the name of a command in columns, called for each of them
+ * @param  context Columns the name is printed in
+ * @param  word Word of the command
+ * @param  value Command
+ * @return true to go on with the next one
+ **/
+static bool cli_command_print_name(void *context, const char *word, void *value)
+{
+	cli_command_columns_t *columns = context;
+
+	if (columns->printed == CLI_COMMAND_HELP_COLUMNS)
+	{
+		columns->printed = 0;
+		tinyrl_printf(columns->this, "\n\r");
+	}
+	tinyrl_printf(columns->this, "%s\t", word);
+	columns->printed++;
+	return true;
+}
+
+/**
+ * @brief Show the commands available, or those starting with some words
+ * @param this Line the help is printed on
+ * @param argc Number of words
+ * @param argv Words of a command, none for all the commands
+ */
+void cli_command_help(tinyrl_t *this, int argc, const cli_token_t *argv)
+{
+	cli_command_t *command;
+	int used, i;
+
+	pthread_rwlock_rdlock(&cli_command_lock);
+	command = cli_command_lookup(&cli_command_root, argc, argv, &used);
+	if (!argc)
+	{
+		/* print help for all commands */
+		tinyrl_radix_walk(command->children, "", 0, cli_command_print, this);
+	}
+	else if (used == argc)
+	{
+		cli_command_print(this, command->name, command);
+	}
+	else
+	{
+		cli_command_columns_t columns = { this, 0 };
+
+		tinyrl_printf(this, "No `");
+		for (i = 0; i < argc; i++)
+			tinyrl_printf(this, i ? " %s" : "%s", argv[i].s);
+		tinyrl_printf(this, "' command.  Valid command names are:\n\r");
+		tinyrl_radix_walk(cli_command_root.children, "", 0, cli_command_print_name, &columns);
+		tinyrl_printf(this, "\n\n\rTry `help [command]\' for more information.\n\r");
+	}
+	pthread_rwlock_unlock(&cli_command_lock);
+}
+
+/**
+ * @brief Close the session, the CLI over the tty quits the application
+ * @param this Line of the session
+ * @param argc Not used
+ * @param argv Not used
+ */
+void cli_command_quit(tinyrl_t *this, int argc, const cli_token_t *argv)
+{
+	/* the CLI closes the session once the command returns */
+	this->sock_fd = 0;
+}
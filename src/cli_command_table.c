@@ -0,0 +1,27 @@
+/**
+ * @file cli_command_table.c
+ * @brief Commands known at build time, generated by cli_command_gen from
+ *        cli_command_table.def. Do not edit.
+ */
+
+#include "cli_command.h"
+
+cli_command_func_t cli_command_help;
+cli_command_func_t cli_command_quit;
+cli_command_func_t cli_command_1;
+cli_command_func_t cli_command_2;
+
+const unsigned cli_command_static_count = 5;
+const unsigned cli_command_static_buckets = 3;
+
+const unsigned cli_command_static_displacement[] =
+{ 2, 2, 2 };
+
+const cli_command_static_t cli_command_static[] =
+{
+{ "command_1", CLI_COMMAND_HASH_NONE, 0, 9, cli_command_1, "", false },
+{ "quit", CLI_COMMAND_HASH_NONE, 0, 4, cli_command_quit, "Close the session", false },
+{ "?", CLI_COMMAND_HASH_NONE, 0, 1, cli_command_help, "Synonym for `help'", true },
+{ "command_2", CLI_COMMAND_HASH_NONE, 0, 9, cli_command_2, "", false },
+{ "help", CLI_COMMAND_HASH_NONE, 0, 4, cli_command_help, "Display this text", true },
+};
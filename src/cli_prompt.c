@@ -11,16 +11,12 @@
 /*** @brief pThread pointer */
 pthread_t xCli_Thread_id;
 
-/** @brief Prototype transport call function */
-typedef void cmd_function_t(char *, tinyrl_t * this);
-
-/** @brief Readline command available table */
-typedef struct
-{
-	char *name; /** User printable name */
-	cmd_function_t *func; /** Function to call */
-	char *doc; /** Documentation  */
-} command_t;
+/** @brief File keeping the history of the prompt across restarts */
+#define CLI_PROMPT_HISTORY_FILE "cli_history"
+/** @brief Number of commands kept in the history */
+#define CLI_PROMPT_HISTORY_LIMIT 1000
+/** @brief Commands displayed by a fuzzy completion */
+#define CLI_PROMPT_FUZZY_MATCHES 16
 
 /** @brief Used to save/restore terminal settings */
 static struct termios cli_terminal_settings;
@@ -28,55 +24,9 @@ static struct termios cli_terminal_settings;
 /* Private functions to cli */
 static char *cli_trim_space_char(char *string);
 static void cli_execute_command(char *line, tinyrl_t * this);
-static command_t *cli_find_command(char *name);
-
-/* Private functions for each command to be executed */
-static void cli_command_help(char *, tinyrl_t * this);
-static void cli_command_quit(char *arg, tinyrl_t * this);
-
-static void cli_command_1(char *arg, tinyrl_t * this);
-static void cli_command_2(char *arg, tinyrl_t * this);
-
-/** @brief Structure with all commands. The table must be in alphabetical order */
-static command_t commands[] =
-{
-{ "command_1", cli_command_1, "" },
-{ "command_2", cli_command_2, "" },
 
-{ "help", cli_command_help, "" },
-{ "quit", cli_command_quit, "" },
-{ "?", cli_command_help, "" },
-
-{ (char *) NULL, (cmd_function_t *) NULL, (char *) NULL } };
-
-/**
- * @brief  Check if current command exists in commands table
- * @param  name Command string to be checked
- * @return Command pointer if success or NULL if command not found
- **/
-static command_t *cli_find_command(char *name)
-{
-	register int i;
-	size_t namelen;
-
-	if ((name == NULL) || (*name == '\0'))
-		return ((command_t *) NULL);
-
-	namelen = strlen(name);
-	for (i = 0; commands[i].name; i++)
-	{
-		if (strncmp(name, commands[i].name, namelen) == 0)
-		{
-			/* make sure the match is unique */
-			if ((commands[i + 1].name) && (strncmp(name, commands[i + 1].name, namelen) == 0))
-				return ((command_t *) NULL);
-			else
-				return (&commands[i]);
-		}
-	}
-
-	return ((command_t *) NULL);
-}
+/** @brief Whether a word no command starts with is completed fuzzily */
+static bool cli_fuzzy;
 
 /**
  * @brief  Each ENTER key this function will be executed.
@@ -86,37 +36,37 @@ static command_t *cli_find_command(char *name)
  **/
 static void cli_execute_command(char *line, tinyrl_t * this)
 {
+	cli_token_t argv[CLI_COMMAND_ARGS];
+	cli_command_t *command;
+	int argc, used;
 
-	register int line_index;
-	command_t *command;
-	char *word;
-	/* Isolate the command word. */
-	line_index = 0;
-
-	while (line[line_index] && (((line[line_index]) == ' ') || ((line[line_index]) == '\t')))
-		line_index++;
-	word = line + line_index;
-
-	while (line[line_index] && !(((line[line_index]) == ' ') || ((line[line_index]) == '\t')))
-		line_index++;
+	/* Split the line into words, the command and its arguments. */
+	argc = cli_command_tokenize(line, argv, CLI_COMMAND_ARGS);
+	if (argc == -EINVAL)
+	{
+		tinyrl_printf(this, "\rMissing closing quote.\n\r");
+		return;
+	}
+	if (argc < 0)
+	{
+		tinyrl_printf(this, "\rToo many arguments.\n\r");
+		return;
+	}
+	if (!argc)
+		return;
 
-	if (line[line_index])
-		line[line_index++] = '\0';
-	command = cli_find_command(word);
+	command = cli_command_find(argc, argv, &used);
 	if (!command)
 	{
-		tinyrl_printf(this, "\r%s: No such command.  There is `help\'.\n\r", word);
+		/* the first word which is not a command, or the last one */
+		if (used == argc)
+			used--;
+		tinyrl_printf(this, "\r%s: No such command.  There is `help\'.\n\r", argv[used].s);
 		return;
 	}
 
-	/* Get argument to command, if any. */
-	while ((((line[line_index]) == ' ') || ((line[line_index]) == '\t')))
-		line_index++;
-
-	word = line + line_index;
-
 	/* invoke the command function. */
-	(*command->func)(word, this);
+	(*command->func)(this, argc - used, argv + used);
 }
 
 /**
@@ -144,6 +94,16 @@ static char *cli_trim_space_char(char *string)
 	return s;
 }
 
+/**
+ * @brief  Complete a word no command starts with to the commands holding its
+ *         characters in order, ranked (off by default)
+ * @param  fuzzy true to turn the fuzzy completion on
+ */
+void cli_prompt_set_fuzzy_completion(bool fuzzy)
+{
+	cli_fuzzy = fuzzy;
+}
+
 /**
  * @brief  Initialize cli functions. Create all necessary threads
  * @return 0 Success
@@ -152,6 +112,7 @@ int cli_prompt_init()
 {
 
 	int r;
+
 	/* Create CLI thread */
 	r = pthread_create(&xCli_Thread_id, NULL, &cli_prompt_thread, NULL);
 	if (r != 0)
@@ -173,12 +134,16 @@ int cli_prompt_deinit()
 {
 	int r;
 
-	/* Cancel CLI Thread */
+	/* Cancel CLI Thread, it closes the history file on its way out */
 	r = pthread_cancel(xCli_Thread_id);
 	if (r != 0)
 	{
 		fprintf(stdout, "Fail canceling thread. ERR=%u.", r);
 	}
+	else
+	{
+		pthread_join(xCli_Thread_id, NULL);
+	}
 
 	/* Restore terminal settings */
 	tcsetattr(0, TCSANOW, &cli_terminal_settings);
@@ -190,38 +155,8 @@ int cli_prompt_deinit()
 
 static bool complete(tinyrl_t *t, bool allow_prefix, bool allow_empty)
 {
-	const char *text;
-	unsigned start;
-	unsigned end;
-	char **matches;
-	bool ret = false;
-
-	/* find the start of the current word */
-	text = tinyrl__get_line(t);
-	start = end = tinyrl__get_point(t);
-	while (start && !isspace(text[start - 1]))
-		start--;
-	if (start == end && allow_empty)
-		return true;
-
-	/* build a list of possible completions */
-	matches = NULL;
-	int count = 0;
-	while ((commands[count].name))
-	{
-		matches = tinyrl_add_match(t, start, matches, commands[count].name);
-		count++;
-	}
-
-	if (!matches)
-		return false;
-
-	/* select the longest completion */
-	ret = tinyrl_complete(t, start, matches, allow_prefix);
-
-	tinyrl_delete_matches(matches);
-
-	return ret;
+	return cli_command_complete(t, allow_prefix, allow_empty,
+				    cli_fuzzy ? CLI_PROMPT_FUZZY_MATCHES : 0);
 }
 
 static bool tab_key(void *context, int key)
@@ -259,6 +194,19 @@ static bool enter_key(void *context, int key)
 	}
 	return false;
 }
+/**
+ * @brief  Write the history to disk and free the line, when the thread ends
+ *         or is cancelled
+ * @param  arg The line
+ */
+static void cli_prompt_cleanup(void *arg)
+{
+	tinyrl_t *t = arg;
+
+	tinyrl_history_delete(t->history);
+	tinyrl_delete(t);
+}
+
 /**
  * @brief  Main cli loop thread
  * @return void *
@@ -270,13 +218,20 @@ void* cli_prompt_thread(void* arg)
 //	td = (struct thread_data *) arg;
 	tinyrl_t *t;
 
+	/* cancelled only while waiting for a key, see tinyrl_readline() */
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
 	t = tinyrl_new(stdin, stdout);
 	tinyrl_bind_key(t, '\t', tab_key, t);
 	tinyrl_bind_key(t, '\r', enter_key, t);
 	tinyrl_bind_key(t, ' ', space_key, t);
 //
-	t->history = tinyrl_history_new(t, 0);
+	t->history = tinyrl_history_new(t, CLI_PROMPT_HISTORY_LIMIT);
+	if (!tinyrl_history_open(t->history, CLI_PROMPT_HISTORY_FILE))
+		fprintf(stdout, "History file %s not used. ERR=%u.\n\r",
+			CLI_PROMPT_HISTORY_FILE, errno);
 	tinyrl_crlf(t);
+	pthread_cleanup_push(cli_prompt_cleanup, t);
 	while (1)
 	{
 		char *line, *cmd;
@@ -294,75 +249,15 @@ void* cli_prompt_thread(void* arg)
 			cli_execute_command(cmd, t);
 		}
 
-		free(line);
-	}
-	tinyrl_history_delete(t->history);
-	tinyrl_delete(t);
-	return 0;
-}
-
-/**
- * @brief Show user command available to be used
- * @param arg String with passed arguments
- */
-static void cli_command_help(char *arg, tinyrl_t * this)
-{
-	register int i;
-	command_t *cmd;
-
-	if (!*arg)
-	{
-		/* print help for all commands */
-		for (i = 0; commands[i].name; i++)
+		/* the quit command closes the session, here the application */
+		if (t->sock_fd == 0)
 		{
-			tinyrl_printf(this, "%s\t\t%s.\n", commands[i].name, commands[i].doc);
+			t->sock_fd = -1;
+			cli_quit_application();
 		}
 
+		free(line);
 	}
-	else if ((cmd = cli_find_command(arg)))
-	{
-		tinyrl_printf(this, "%s\t\t%s.\n", cmd->name, cmd->doc);
-
-	}
-	else
-	{
-		int printed = 0;
-
-		tinyrl_printf(this, "No `%s' command.  Valid command names are:\n", arg);
-
-		for (i = 0; commands[i].name; i++)
-		{
-			/* Print in six columns. */
-			if (printed == 6)
-			{
-				printed = 0;
-				tinyrl_printf(this, "\n");
-			}
-
-			tinyrl_printf(this, "%s\t", commands[i].name);
-			printed++;
-		}
-
-		tinyrl_printf(this, "\n\nTry `help [command]\' for more information.\n");
-	}
-}
-
-/**
- * @brief Quit application
- * @param arg Not used
- */
-static void cli_command_quit(char *arg, tinyrl_t * this)
-{
-	cli_quit_application();
-}
-
-static void cli_command_1(char *arg, tinyrl_t * this)
-{
-	tinyrl_printf(this, "You typed command 1");
-	return;
-}
-static void cli_command_2(char *arg, tinyrl_t * this)
-{
-	tinyrl_printf(this, "command 2!");
-	return;
+	pthread_cleanup_pop(1);
+	return 0;
 }
@@ -5,73 +5,108 @@
  * @brief User CLI (Command line interface) over telnet
  */
 
+/* make sure we can get the CPU affinity calls */
+#define _GNU_SOURCE
+
 #include "cli_telnet.h"
 
-/***@brief CLI Telnet pThread pointer */
-static pthread_t xCli_Telnet_Thread_id;
+#include <sched.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+
+#if defined(CLI_TELNET_IO_URING)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
 
-int sockfd;
-int newsocket_fd;
+/** @brief TCP port the telnet CLI listens on */
+#define CLI_TELNET_PORT 2023
+/** @brief Prompt displayed on every telnet session */
+#define CLI_TELNET_PROMPT "CLI> "
+/** @brief Maximum number of events handled per epoll_wait() call */
+#define CLI_TELNET_MAX_EVENTS 64
+/** @brief Bytes read from a session socket at once */
+#define CLI_TELNET_INPUT_SIZE 4096
+/** @brief Commands kept in the history of the sessions */
+#define CLI_TELNET_HISTORY_SIZE 256
+/** @brief Commands displayed by a fuzzy completion */
+#define CLI_TELNET_FUZZY_MATCHES 16
 
-/** @brief Prototype transport call function */
-typedef void cmd_function_t(tinyrl_t *, char *);
-/** @brief Readline command available table */
+/**
+ * @brief Telnet worker. Each worker runs its own event loop with its own
+ *        SO_REUSEPORT listening socket, so the kernel spreads incoming
+ *        connections across the workers.
+ */
 typedef struct
 {
-	char *name; /**@brief Function displayed name*/
-	cmd_function_t *func; /**@brief Function to call */
-	char *doc; /**@brief Command Documentation  */
-} command_t;
-
-/*@brief Private functions to cli */
-static char *cli_telnet_trim_space_char(char *string);
-static void cli_telnet_execute_command(char *line, tinyrl_t * this);
-static command_t *cli_telnet_find_command(char *name);
+	pthread_t thread_id; /**@brief Worker thread */
+	unsigned index; /**@brief Worker number, selects the CPU it is pinned to */
+	int sockfd; /**@brief Listening socket of this worker */
+	int epoll_fd; /**@brief Event loop owning the listening socket and the worker sessions */
+	int wake_fd; /**@brief eventfd written by cli_telnet_deinit() to wake the event loop */
+	bool stop; /**@brief Set by cli_telnet_deinit(), the event loop returns once woken */
+	char input[CLI_TELNET_INPUT_SIZE]; /**@brief Read buffer shared by the worker sessions, processed entirely before the next read */
+	struct cli_telnet_session *sessions; /**@brief Sessions served by the worker, closed when it stops */
+#if defined(CLI_TELNET_IO_URING)
+	struct cli_telnet_uring *ring; /**@brief io_uring transport, NULL when the epoll loop is used */
+#endif
+} cli_telnet_worker_t;
 
-/*@brief Private functions for each command to be executed */
-static void cli_telnet_command_help(tinyrl_t * this, char *arg);
-static void cli_telnet_command_quit(tinyrl_t * this, char *arg);
+/** @brief Number of workers requested, 0 starts one per CPU the process may run on */
+static unsigned cli_telnet_workers_requested;
+/** @brief Workers started by cli_telnet_init() */
+static cli_telnet_worker_t *cli_telnet_workers;
+static unsigned cli_telnet_workers_count;
+/** @brief Whether each session keeps a history of its own, set before cli_telnet_init() */
+static bool cli_telnet_history_private;
+/** @brief History shared by the sessions of all the workers, NULL when each session has its own */
+static struct tinyrl_history_shared *cli_telnet_history;
 
-static void cli_command_1(tinyrl_t * this, char *arg);
-static void cli_command_2(tinyrl_t * this, char *arg);
-
-/** @brief Structure with all commands. The table must be in alphabetical order */
-static command_t commands[] =
+/** @brief Telnet protocol parser states */
+typedef enum
 {
-{ "command_1", cli_command_1, "" },
-{ "command_2", cli_command_2, "" },
+	CLI_TELNET_DATA = 0, /**@brief Data bytes */
+	CLI_TELNET_CR, /**@brief Data, after a CR */
+	CLI_TELNET_IAC, /**@brief After IAC */
+	CLI_TELNET_OPTION, /**@brief After IAC WILL/WONT/DO/DONT */
+	CLI_TELNET_SB, /**@brief Inside a subnegotiation */
+	CLI_TELNET_SB_IAC /**@brief After IAC inside a subnegotiation */
+} cli_telnet_state_t;
 
-{ "help", cli_telnet_command_help, "" },
-{ "quit", cli_telnet_command_quit, "" },
-{ "?", cli_telnet_command_help, "" },
+/** @brief Telnet connection served by the event loop */
+typedef struct cli_telnet_session
+{
+	int fd; /**@brief Session socket */
+	FILE *stream; /**@brief Stream wrapping the socket, used by tinyrl */
+	tinyrl_t *t; /**@brief Line editor of the session */
+	cli_telnet_worker_t *worker; /**@brief Worker serving the session */
+	struct cli_telnet_session *prev, *next; /**@brief Sessions of the same worker */
+	cli_telnet_state_t telnet_state; /**@brief Telnet protocol parser state */
+	unsigned char telnet_verb; /**@brief WILL, WONT, DO or DONT waiting for its option */
+	unsigned char telnet_sb[32]; /**@brief Subnegotiation data being received */
+	unsigned telnet_sb_len;
+	unsigned char telnet_local[32]; /**@brief Options enabled on the server side, one bit each */
+	unsigned char telnet_remote[32]; /**@brief Options enabled on the client side, one bit each */
+	unsigned char telnet_local_pending[32]; /**@brief Options the server offered (WILL) without an answer yet */
+	unsigned char telnet_remote_pending[32]; /**@brief Options the server asked for (DO) without an answer yet */
+	bool output_pending; /**@brief The socket was full, the session waits to be writable instead of readable */
+#if defined(CLI_TELNET_IO_URING)
+	unsigned sending; /**@brief Sends submitted from the output queue of the editor and not completed */
+	bool send_failed; /**@brief A send failed, the rest of the output is dropped */
+	bool recv_armed; /**@brief Multishot receive is active */
+	bool closing; /**@brief Released once no operation references the session */
+	bool dirty; /**@brief Listed for the end of loop iteration flush */
+	struct cli_telnet_session *dirty_next;
+#endif
+} cli_telnet_session_t;
 
-{ (char *) NULL, (cmd_function_t *) NULL, (char *) NULL } };
+/*@brief Private functions to cli */
+static char *cli_telnet_trim_space_char(char *string);
+static void cli_telnet_execute_command(char *line, tinyrl_t * this);
 
-/**
- * @brief  Check if current command exists in commands table
- * @param  Command name (string) to be checked
- * @return Command pointer if success or NULL if command not found
- **/
-static command_t *cli_telnet_find_command(char *name)
-{
-	register int i;
-	size_t namelen;
-	if ((name == NULL) || (name == '\0'))
-		return ((command_t *) NULL);
-	namelen = strlen(name);
-	for (i = 0; commands[i].name; i++)
-	{
-		if (strncmp(name, commands[i].name, namelen) == 0)
-		{
-			/* make sure the match is unique */
-			if ((commands[i + 1].name) && (strncmp(name, commands[i + 1].name, namelen) == 0))
-				return ((command_t *) NULL);
-			else
-				return (&commands[i]);
-		}
-	}
-	return ((command_t *) NULL);
-}
+/** @brief Whether a word no command starts with is completed fuzzily */
+static bool cli_telnet_fuzzy;
 
 /**
  * @brief  Each ENTER key this function will be executed.
@@ -81,41 +116,37 @@ static command_t *cli_telnet_find_command(char *name)
  **/
 static void cli_telnet_execute_command(char *line, tinyrl_t * this)
 {
-	int line_index;
-	line_index = 0;
-	command_t *command;
-	char *word;
-	/* Isolate the command word. */
-	for (line_index = 0; line_index < strlen(line); line_index++)
+	cli_token_t argv[CLI_COMMAND_ARGS];
+	cli_command_t *command;
+	int argc, used;
+
+	/* Split the line into words, the command and its arguments. */
+	argc = cli_command_tokenize(line, argv, CLI_COMMAND_ARGS);
+	if (argc == -EINVAL)
 	{
-		if (!(line[line_index] && (((line[line_index]) == ' ') || ((line[line_index]) == '\t'))))
-		{
-			break;
-		}
+		tinyrl_printf(this, "\nMissing closing quote.\n\r");
+		return;
 	}
+	if (argc < 0)
+	{
+		tinyrl_printf(this, "\nToo many arguments.\n\r");
+		return;
+	}
+	if (!argc)
+		return;
 
-	word = line + line_index;
-
-	while (line[line_index] && !(((line[line_index]) == ' ') || ((line[line_index]) == '\t')))
-		line_index++;
-
-	if (line[line_index])
-		line[line_index++] = '\0';
-	command = cli_telnet_find_command(word);
+	command = cli_command_find(argc, argv, &used);
 	if (!command)
 	{
-		tinyrl_printf(this, "\n%s: No such command.  There is `help\'.\n\r", word);
+		/* the first word which is not a command, or the last one */
+		if (used == argc)
+			used--;
+		tinyrl_printf(this, "\n%s: No such command.  There is `help\'.\n\r", argv[used].s);
 		return;
 	}
 
-	/* Get argument to command, if any. */
-	while ((((line[line_index]) == ' ') || ((line[line_index]) == '\t')))
-		line_index++;
-
-	word = line + line_index;
-
 	/* invoke the command function. */
-	(*command->func)(this, word);
+	(*command->func)(this, argc - used, argv + used);
 }
 
 /**
@@ -127,38 +158,8 @@ static void cli_telnet_execute_command(char *line, tinyrl_t * this)
  **/
 static bool complete(tinyrl_t *t, bool allow_prefix, bool allow_empty)
 {
-	const char *text;
-	unsigned start;
-	unsigned end;
-	char **matches;
-	bool ret = false;
-
-	/* find the start of the current word */
-	text = tinyrl__get_line(t);
-	start = end = tinyrl__get_point(t);
-	while (start && !isspace(text[start - 1]))
-		start--;
-	if (start == end && allow_empty)
-		return true;
-
-	/* build a list of possible completions */
-	matches = NULL;
-	int count = 0;
-	while ((commands[count].name))
-	{
-		matches = tinyrl_add_match(t, start, matches, commands[count].name);
-		count++;
-	}
-
-	if (!matches)
-		return false;
-
-	/* select the longest completion */
-	ret = tinyrl_complete(t, start, matches, allow_prefix);
-
-	tinyrl_delete_matches(matches);
-
-	return ret;
+	return cli_command_complete(t, allow_prefix, allow_empty,
+				    cli_telnet_fuzzy ? CLI_TELNET_FUZZY_MATCHES : 0);
 }
 /**
  * @brief Strip whitespace from the start and end of string.
@@ -216,282 +217,1386 @@ static bool space_key(void *context, int key)
 }
 
 /**
- * @brief function binded to ENTER key
+ * @brief function binded to ENTER key. The line is always handed to the
+ *        command interpreter, which reports unknown commands itself.
  * @param context: data structure (tinyrl_t) used on the CLI
  */
 static bool enter_key(void *context, int key)
 {
 	tinyrl_t *t = context;
+	bool ret;
 
-	if (complete(t, true, true))
-	{
-		tinyrl_crlf(t);
-		tinyrl_done(t);
-		return true;
-	}
-	return false;
+	ret = complete(t, true, true);
+	tinyrl_crlf(t);
+	tinyrl_done(t);
+	return ret;
 }
 
+#if defined(CLI_TELNET_IO_URING)
+static ssize_t cli_telnet_uring_write(void *context, const char *buf, size_t len);
+static void cli_telnet_uring_dirty(cli_telnet_session_t *session);
+#endif
+
 /**
- * @brief Calls tinyrl read and interpret the input
- * @return Void
- **/
-static void * new_socket_thread(void* arg)
+ * @brief Send data to a session, through the transport used by its worker
+ * @param session: session to send to
+ * @param buf: data to be sent
+ * @param len: length of data
+ */
+static void cli_telnet_session_send(cli_telnet_session_t *session, const void *buf, size_t len)
 {
-	int newsocket_fd;
-	newsocket_fd = (int) arg;
-	pthread_detach(pthread_self());
+	/* behind the output of the line editor, the socket may be full */
+	tinyrl_write(session->t, buf, len);
+#if defined(CLI_TELNET_IO_URING)
+	if (session->worker->ring)
+		cli_telnet_uring_dirty(session);
+#endif
+}
+
+/**
+ * @brief Create a new telnet session for an accepted connection
+ * @param worker: worker which accepted the connection
+ * @param fd: accepted socket file descriptor
+ * @return Session pointer or NULL on failure
+ */
+static cli_telnet_session_t *cli_telnet_session_new(cli_telnet_worker_t *worker, int fd)
+{
+	cli_telnet_session_t *session;
 
 	/**
-	 * Send telnet command characters to make it character mode
+	 * Send telnet command characters to make it character mode and to have
+	 * the client report its window size
 	 * Declaration of the array of command characters
 	 */
-	const static unsigned char send_telnet[] =
+	static const unsigned char send_telnet[] =
 	{
 	IAC,
 	WILL,
 	TELOPT_SGA,
 	IAC,
 	WILL,
-	TELOPT_ECHO };
+	TELOPT_ECHO,
+	IAC,
+	DO,
+	TELOPT_NAWS };
+
+	session = calloc(1, sizeof(*session));
+	if (!session)
+		return NULL;
+
+	session->fd = fd;
+	session->worker = worker;
+	session->stream = (FILE*) fdopen(fd, "w+");
+	if (!session->stream)
+	{
+		free(session);
+		return NULL;
+	}
+
+	session->t = tinyrl_new(session->stream, session->stream);
+	if (!session->t)
+	{
+		/* closes the socket as well */
+		fclose(session->stream);
+		free(session);
+		return NULL;
+	}
+#if defined(CLI_TELNET_IO_URING)
+	if (worker->ring)
+		tinyrl__set_output(session->t, cli_telnet_uring_write, session);
+#endif
+
 	/*
 	 * Sends (writes) the command array into the socket
 	 */
-	write(newsocket_fd, send_telnet, sizeof(send_telnet));
+	cli_telnet_session_send(session, send_telnet, sizeof(send_telnet));
+	session->telnet_local_pending[TELOPT_SGA >> 3] |= 1 << (TELOPT_SGA & 7);
+	session->telnet_local_pending[TELOPT_ECHO >> 3] |= 1 << (TELOPT_ECHO & 7);
+	session->telnet_remote_pending[TELOPT_NAWS >> 3] |= 1 << (TELOPT_NAWS & 7);
 	fprintf(stdout, "Setting telnet session.");
 
-	FILE * fdstream;
-	fdstream = (FILE*) fdopen(newsocket_fd, "w+");
+	tinyrl_bind_key(session->t, '\t', tab_key, session->t);
+	tinyrl_bind_key(session->t, '\r', enter_key, session->t);
+	tinyrl_bind_key(session->t, ' ', space_key, session->t);
 
-	tinyrl_t * t;
-	t = tinyrl_new(fdstream, fdstream);
-	tinyrl_bind_key(t, '\t', tab_key, t);
-	tinyrl_bind_key(t, '\r', enter_key, t);
-	tinyrl_bind_key(t, ' ', space_key, t);
+	session->t->history = tinyrl_history_new(session->t, CLI_TELNET_HISTORY_SIZE);
+	tinyrl_history_share(session->t->history, cli_telnet_history);
+	session->t->thread_id = pthread_self();
+	session->t->sock_fd = fd;
+
+	tinyrl_readline_begin(session->t, CLI_TELNET_PROMPT);
+
+	session->next = worker->sessions;
+	if (worker->sessions)
+		worker->sessions->prev = session;
+	worker->sessions = session;
+	return session;
+}
+
+/**
+ * @brief Release a telnet session and close its socket
+ * @param session: session to be released
+ */
+static void cli_telnet_session_delete(cli_telnet_session_t *session)
+{
+	const tinyrl_stats_t *stats = tinyrl__get_stats(session->t);
 
-	t->history = tinyrl_history_new(t, 5);
-	t->thread_id = pthread_self();
-	t->sock_fd = newsocket_fd;
+	fprintf(stdout, "Closing telnet session. %lu fragments in %lu flushes, %lu writes, %lu bytes.\n\r", stats->appends,
+		stats->flushes, stats->syscalls, stats->bytes);
+	if (session->worker->epoll_fd >= 0)
+		epoll_ctl(session->worker->epoll_fd, EPOLL_CTL_DEL, session->fd, NULL);
+#if defined(CLI_TELNET_IO_URING)
+	/* nothing may be queued to the ring from here on */
+	if (session->worker->ring)
+		tinyrl__set_output(session->t, NULL, NULL);
+#endif
+	if (session->prev)
+		session->prev->next = session->next;
+	else
+		session->worker->sessions = session->next;
+	if (session->next)
+		session->next->prev = session->prev;
+	tinyrl_history_delete(session->t->history);
+	tinyrl_delete(session->t);
+#if defined(CLI_TELNET_IO_URING)
+	/* a receive still armed holds the socket, the client is told now */
+	if (session->worker->ring)
+		shutdown(session->fd, SHUT_RDWR);
+#endif
+	/* closes the socket as well */
+	fclose(session->stream);
+	free(session);
+}
 
+/**
+ * @brief Hand data bytes of a session to its line editor. Every line
+ *        completed by the data is executed in turn.
+ * @param session: session the data belongs to
+ * @param buf: data bytes, free of telnet commands
+ * @param len: number of data bytes
+ * @return true if the session is still alive, false if it has to be closed
+ */
+static bool cli_telnet_session_feed(cli_telnet_session_t *session, const char *buf, size_t len)
+{
 	char *line, *cmd;
-	line = malloc(64);
-	cmd = malloc(64);
+	size_t used;
 
-	while (1)
+	while (len)
 	{
-		line = tinyrl_readline(t, "CLI> ");
-		if (!line)
+		if (TINYRL_FEED_MORE == tinyrl_feed(session->t, buf, len, &used))
 			break;
+
+		buf += used;
+		len -= used;
+
+		line = tinyrl_readline_end(session->t);
+
 		/* Remove leading and trailing whitespace from the line. */
 		cmd = cli_telnet_trim_space_char(line);
 
 		/* If anything left, add to history and execute it. */
 		if (*cmd)
 		{
-			tinyrl_history_add(t->history, line);
-			cli_telnet_execute_command(cmd, t);
+			tinyrl_history_add(session->t->history, line);
+			cli_telnet_execute_command(cmd, session->t);
 		}
+		free(line);
+
+		/* the quit command clears the socket descriptor */
+		if (session->t->sock_fd == 0)
+			return false;
+
+		tinyrl_readline_begin(session->t, CLI_TELNET_PROMPT);
 	}
-	return NULL;
+	return true;
 }
 
 /**
- * @brief  Main cli telnet loop thread
- * @return void *
+ * @brief Tell whether the server side of a telnet option is supported
+ * @param option: telnet option
+ * @return true if the server may enable the option
  */
-void* cli_telnet_thread(void * arg)
+static bool cli_telnet_local_option(unsigned char option)
 {
-	xCli_Telnet_Thread_id = pthread_self();
-	socklen_t client_socket_len;
-	/** @brief file descriptors for socket and new sockets */
-	int portno;
-	int r;
-	static struct sockaddr_in serv_addr, client_socket_addr;
-	pthread_t thread_id;
-	while (1)
+	return option == TELOPT_SGA || option == TELOPT_ECHO;
+}
+
+/**
+ * @brief Tell whether the client side of a telnet option is supported
+ * @param option: telnet option
+ * @return true if the client may enable the option
+ */
+static bool cli_telnet_remote_option(unsigned char option)
+{
+	return option == TELOPT_NAWS;
+}
+
+/**
+ * @brief Answer a WILL, WONT, DO or DONT request of the client. Only
+ *        requests changing the state of an option are answered, which
+ *        keeps the negotiation from looping (RFC 854). The answers to the
+ *        requests of the server are not acknowledged (RFC 1143).
+ * @param session: session the request was received on
+ * @param verb: WILL, WONT, DO or DONT
+ * @param option: telnet option
+ */
+static void cli_telnet_negotiate(cli_telnet_session_t *session, unsigned char verb, unsigned char option)
+{
+	unsigned char reply[3] =
+	{ IAC, 0, option };
+	unsigned char bit = 1 << (option & 7);
+	unsigned char *local = &session->telnet_local[option >> 3];
+	unsigned char *remote = &session->telnet_remote[option >> 3];
+	unsigned char *local_pending = &session->telnet_local_pending[option >> 3];
+	unsigned char *remote_pending = &session->telnet_remote_pending[option >> 3];
+
+	switch (verb)
 	{
-		sockfd = socket(AF_INET, SOCK_STREAM, 0);
-		if (sockfd < 0)
+	case DO:
+		if (*local_pending & bit)
 		{
-			fprintf(stdout, "ERROR opening socket.\n\rWill retry.\n\rERR=%u.\n\r", sockfd);
-			fflush(stdout);
-			sleep(1);
+			/* the client accepts our WILL */
+			*local_pending &= ~bit;
+			*local |= bit;
+			return;
+		}
+		if (*local & bit)
+			return;
+		if (cli_telnet_local_option(option))
+		{
+			*local |= bit;
+			reply[1] = WILL;
 		}
 		else
 		{
-			portno = 2023;
-			serv_addr.sin_family = AF_INET;
-			serv_addr.sin_addr.s_addr = INADDR_ANY;
-			serv_addr.sin_port = htons(portno);
+			reply[1] = WONT;
+		}
+		break;
+	case DONT:
+		if (*local_pending & bit)
+		{
+			/* the client refuses our WILL, the option stays disabled */
+			*local_pending &= ~bit;
+			return;
+		}
+		if (!(*local & bit))
+			return;
+		*local &= ~bit;
+		reply[1] = WONT;
+		break;
+	case WILL:
+		if (*remote_pending & bit)
+		{
+			/* the client accepts our DO */
+			*remote_pending &= ~bit;
+			*remote |= bit;
+			return;
+		}
+		if (*remote & bit)
+			return;
+		if (cli_telnet_remote_option(option))
+		{
+			*remote |= bit;
+			reply[1] = DO;
+		}
+		else
+		{
+			reply[1] = DONT;
+		}
+		break;
+	case WONT:
+		if (*remote_pending & bit)
+		{
+			/* the client refuses our DO, the option stays disabled */
+			*remote_pending &= ~bit;
+			return;
+		}
+		if (!(*remote & bit))
+			return;
+		*remote &= ~bit;
+		reply[1] = DONT;
+		break;
+	default:
+		return;
+	}
+	cli_telnet_session_send(session, reply, sizeof(reply));
+}
+
+/**
+ * @brief Act on a complete subnegotiation. Only the window size (NAWS,
+ *        RFC 1073) is used, it sets the width the line editor wraps at.
+ * @param session: session the subnegotiation was received on
+ */
+static void cli_telnet_subnegotiation(cli_telnet_session_t *session)
+{
+	const unsigned char *sb = session->telnet_sb;
+
+	if (session->telnet_sb_len >= 5 && sb[0] == TELOPT_NAWS)
+	{
+		/* IAC SB NAWS <width16> <height16> IAC SE, 0 means unknown */
+		tinyrl__set_width(session->t, (sb[1] << 8) | sb[2]);
+	}
+}
+
+/**
+ * @brief Interpret input received on a session. The telnet protocol is
+ *        parsed first and only the data bytes reach the line editor, in
+ *        runs as long as the received buffer allows. The parser state is
+ *        kept in the session so commands may be split across reads.
+ * @param session: session the input belongs to
+ * @param buf: received data
+ * @param len: length of received data
+ * @return true if the session is still alive, false if it has to be closed
+ */
+static bool cli_telnet_session_process(cli_telnet_session_t *session, const char *buf, size_t len)
+{
+	size_t i, start = 0;
+
+	for (i = 0; i < len; i++)
+	{
+		unsigned char c = buf[i];
+
+		switch (session->telnet_state)
+		{
+		case CLI_TELNET_CR:
+			session->telnet_state = CLI_TELNET_DATA;
+			/* telnet ends lines with CR LF or CR NUL, the CR alone is the key */
+			if (c == '\n' || c == '\0')
+			{
+				if (!cli_telnet_session_feed(session, buf + start, i - start))
+					return false;
+				start = i + 1;
+				break;
+			}
+			/* fall through */
+		case CLI_TELNET_DATA:
+			if (c == IAC)
+			{
+				if (!cli_telnet_session_feed(session, buf + start, i - start))
+					return false;
+				start = i + 1;
+				session->telnet_state = CLI_TELNET_IAC;
+			}
+			else if (c == '\r')
+			{
+				session->telnet_state = CLI_TELNET_CR;
+			}
+			break;
 
-			if (bind(sockfd, (struct sockaddr *) &serv_addr, sizeof(serv_addr)) < 0)
+		case CLI_TELNET_IAC:
+			session->telnet_state = CLI_TELNET_DATA;
+			switch (c)
 			{
-				fprintf(stdout, "ERROR binding socket. Will retry. ERR=%u.\n\r", errno);
-				fflush(stdout);
-				sleep(1);
+			case IAC:
+				/* escaped 255 data byte, starts the next run */
+				start = i;
+				continue;
+			case WILL:
+			case WONT:
+			case DO:
+			case DONT:
+				session->telnet_verb = c;
+				session->telnet_state = CLI_TELNET_OPTION;
+				break;
+			case SB:
+				session->telnet_sb_len = 0;
+				session->telnet_state = CLI_TELNET_SB;
+				break;
+			default:
+				/* NOP, GA, DM, BREAK, IP, AO, AYT, EC, EL: nothing to do */
+				break;
+			}
+			start = i + 1;
+			break;
+
+		case CLI_TELNET_OPTION:
+			cli_telnet_negotiate(session, session->telnet_verb, c);
+			session->telnet_state = CLI_TELNET_DATA;
+			start = i + 1;
+			break;
+
+		case CLI_TELNET_SB:
+			if (c == IAC)
+				session->telnet_state = CLI_TELNET_SB_IAC;
+			else if (session->telnet_sb_len < sizeof(session->telnet_sb))
+				session->telnet_sb[session->telnet_sb_len++] = c;
+			start = i + 1;
+			break;
+
+		case CLI_TELNET_SB_IAC:
+			if (c == SE)
+			{
+				cli_telnet_subnegotiation(session);
+				session->telnet_state = CLI_TELNET_DATA;
 			}
 			else
 			{
-				fprintf(stdout, "Socket successfully binded.");
-				while (1)
-				{
-					if (listen(sockfd, 1) < 0)
-					{
-						fprintf(stdout, "ERROR listening socket. Will retry. ERR=%u.\n\r", errno);
-						fflush(stdout);
-						sleep(1);
-					}
-					else
-					{
-						if ((newsocket_fd = accept(sockfd, (struct sockaddr *) &client_socket_addr, &client_socket_len)) < 0)
-						{
-							fprintf(stdout, "ERROR accepting connection from socket. Will retry. ERR=%u.\n\r", errno);
-							fflush(stdout);
-							sleep(1);
-						}
-						else
-						{
-							r = pthread_create(&thread_id, NULL, &new_socket_thread, newsocket_fd);
-							if (r != 0)
-							{
-								fprintf(stdout, "ERROR creating thread. Will retry. ERR=%u.\n\r", errno);
-								fflush(stdout);
-								sleep(1);
-							}
-						}
-					}
-				}
-				close(sockfd);
-				return 0;
+				/* IAC IAC is a 255 data byte of the subnegotiation */
+				if (session->telnet_sb_len < sizeof(session->telnet_sb))
+					session->telnet_sb[session->telnet_sb_len++] = c;
+				session->telnet_state = CLI_TELNET_SB;
 			}
+			start = i + 1;
+			break;
 		}
-		sleep(1);
 	}
-	return 0;
+
+	return cli_telnet_session_feed(session, buf + start, len - start);
 }
 
 /**
- * @brief Initialize cli telnet functions. Create the main telnet thread loop
- * @return 0 Success
+ * @brief Read the pending input of a session and interpret it
+ * @param session: session with input available
+ * @return true if the session is still alive, false if it has to be closed
  */
-int cli_telnet_init()
+static bool cli_telnet_session_input(cli_telnet_session_t *session)
 {
+	char *c = session->worker->input;
+	ssize_t r;
 
-	int r;
-
-	/* Create CLI Telnet thread */
-	r = pthread_create(&xCli_Telnet_Thread_id, NULL, &cli_telnet_thread, NULL);
-	if (r != 0)
+	r = read(session->fd, c, sizeof(session->worker->input));
+	if (r <= 0)
 	{
-		fprintf(stdout, "Fail creating thread. ERR=%u.", r);
+		if (r < 0 && (errno == EAGAIN || errno == EINTR))
+			return true;
+		return false;
 	}
 
-	return r;
+	return cli_telnet_session_process(session, c, r);
 }
 
 /**
- * @brief  Deinitialize cli telnet functions.
- * @return 0 Success
+ * @brief Send the output queued by a session. When the socket cannot take
+ *        all of it the session waits for the socket to be writable, and
+ *        its input is not read meanwhile: a client which does not read is
+ *        not given more output to queue.
+ * @param session: session to flush
+ * @return true if the session is still alive, false if it has to be closed
  */
-int cli_telnet_deinit()
+static bool cli_telnet_session_output(cli_telnet_session_t *session)
 {
+	struct epoll_event ev;
 	int r;
 
-	r=close(sockfd);
+	r = tinyrl_flush(session->t);
+	if (r < 0)
+		return false;
 
-	if (r != 0)
+	if ((r == TINYRL_FLUSH_PENDING) != session->output_pending)
+	{
+		session->output_pending = !session->output_pending;
+		ev.events = (session->output_pending ? EPOLLOUT : EPOLLIN) | EPOLLRDHUP;
+		ev.data.ptr = session;
+		if (epoll_ctl(session->worker->epoll_fd, EPOLL_CTL_MOD, session->fd, &ev) < 0)
 		{
-			fprintf(stdout, "Fail closing telnet socket. ERR=%u.\n\r", r);
+			fprintf(stdout, "ERROR registering telnet session. ERR=%u.\n\r", errno);
+			fflush(stdout);
+			return false;
 		}
-	/* Cancel CLI Telnet Thread */
-	r = pthread_cancel(xCli_Telnet_Thread_id);
-	if (r != 0)
-	{
-		fprintf(stdout, "Fail canceling thread. ERR=%u.", r);
 	}
-	else
+	return true;
+}
+
+/**
+ * @brief Accept all pending connections and register them on the event loop
+ * @param worker: worker owning the listening socket
+ */
+static void cli_telnet_accept(cli_telnet_worker_t *worker)
+{
+	struct sockaddr_in client_socket_addr;
+	socklen_t client_socket_len;
+	struct epoll_event ev;
+	cli_telnet_session_t *session;
+	int newsocket_fd;
+
+	for (;;)
 	{
-		fprintf(stdout, "Cli Telnet deinitialized.");
+		client_socket_len = sizeof(client_socket_addr);
+		/* the session output waits for EPOLLOUT rather than block the worker */
+		newsocket_fd = accept4(worker->sockfd, (struct sockaddr *) &client_socket_addr, &client_socket_len,
+				       SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (newsocket_fd < 0)
+		{
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			{
+				fprintf(stdout, "ERROR accepting connection from socket. ERR=%u.\n\r", errno);
+				fflush(stdout);
+			}
+			return;
+		}
+
+		session = cli_telnet_session_new(worker, newsocket_fd);
+		if (!session)
+		{
+			fprintf(stdout, "ERROR creating telnet session.\n\r");
+			fflush(stdout);
+			close(newsocket_fd);
+			continue;
+		}
+
+		ev.events = EPOLLIN | EPOLLRDHUP;
+		ev.data.ptr = session;
+		if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, newsocket_fd, &ev) < 0)
+		{
+			fprintf(stdout, "ERROR registering telnet session. ERR=%u.\n\r", errno);
+			fflush(stdout);
+			cli_telnet_session_delete(session);
+		}
+		else if (!cli_telnet_session_output(session))
+		{
+			/* the prompt could not be sent */
+			cli_telnet_session_delete(session);
+		}
 	}
-	return 0;
 }
 
 /**
- * @brief Show commands available
- * @param this: data structure for a specific tinyrl instance
- * @param arg:  String with passed arguments
+ * @brief Event loop serving the listening socket and every session of a
+ *        worker. Sessions are identified by the epoll data pointer, the
+ *        listening socket is registered with a NULL pointer and the wake up
+ *        eventfd with the worker pointer.
+ * @param worker: worker owning the event loop
  */
-static void cli_telnet_command_help(tinyrl_t * this, char *arg)
+static void cli_telnet_event_loop(cli_telnet_worker_t *worker)
 {
-	register int i;
-	command_t *cmd;
-	if (!*arg)
+	struct epoll_event ev, events[CLI_TELNET_MAX_EVENTS];
+	int i, n;
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, worker->sockfd, &ev) < 0)
+	{
+		fprintf(stdout, "ERROR registering telnet socket. ERR=%u.\n\r", errno);
+		fflush(stdout);
+		return;
+	}
+	ev.data.ptr = worker;
+	if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, worker->wake_fd, &ev) < 0)
+	{
+		fprintf(stdout, "ERROR registering telnet wake up. ERR=%u.\n\r", errno);
+		fflush(stdout);
+		return;
+	}
+
+	while (!__atomic_load_n(&worker->stop, __ATOMIC_ACQUIRE))
 	{
-		/* print help for all commands */
-		for (i = 0; commands[i].name; i++)
+		n = epoll_wait(worker->epoll_fd, events, CLI_TELNET_MAX_EVENTS, -1);
+		if (n < 0)
 		{
-			tinyrl_printf(this, "%s\t\t%s.\n\r", commands[i].name, commands[i].doc);
+			if (errno == EINTR)
+				continue;
+			fprintf(stdout, "ERROR waiting for telnet events. ERR=%u.\n\r", errno);
+			fflush(stdout);
+			return;
+		}
 
+		for (i = 0; i < n; i++)
+		{
+			cli_telnet_session_t *session = events[i].data.ptr;
+
+			if (!session)
+			{
+				cli_telnet_accept(worker);
+			}
+			else if (events[i].data.ptr == worker)
+			{
+				/* cli_telnet_deinit(), the loop ends with this iteration */
+			}
+			else if ((events[i].events & EPOLLIN) ? cli_telnet_session_input(session)
+				 : (events[i].events & EPOLLOUT) != 0)
+			{
+				/* still alive, level triggered epoll reports what is left */
+				if (!cli_telnet_session_output(session))
+					cli_telnet_session_delete(session);
+			}
+			else
+			{
+				/* hang up, error or quit command */
+				cli_telnet_session_delete(session);
+			}
 		}
 	}
-	else if ((cmd = cli_telnet_find_command(arg)))
+}
+
+/**
+ * @brief  Open the listening socket of a worker. The port is shared by all
+ *         workers through SO_REUSEPORT.
+ * @param  worker: worker the socket is opened for
+ * @return Listening socket or -1 on failure
+ */
+static int cli_telnet_listen(cli_telnet_worker_t *worker)
+{
+	struct sockaddr_in serv_addr;
+	int fd;
+	int on = 1;
+
+	fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	if (fd < 0)
 	{
-		tinyrl_printf(this, "%s\t\t%s.\n\r", cmd->name, cmd->doc);
+		fprintf(stdout, "ERROR opening socket.\n\rWill retry.\n\rERR=%u.\n\r", errno);
+		fflush(stdout);
+		return -1;
 	}
-	else
+
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0
+	    || setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0)
 	{
-		int printed = 0;
+		fprintf(stdout, "ERROR setting socket options. Will retry. ERR=%u.\n\r", errno);
+		fflush(stdout);
+		close(fd);
+		return -1;
+	}
 
-		tinyrl_printf(this, "No `%s' command.  Valid command names are:\n\r", arg);
+	memset(&serv_addr, 0, sizeof(serv_addr));
+	serv_addr.sin_family = AF_INET;
+	serv_addr.sin_addr.s_addr = INADDR_ANY;
+	serv_addr.sin_port = htons(CLI_TELNET_PORT);
 
-		for (i = 0; commands[i].name; i++)
+	if (bind(fd, (struct sockaddr *) &serv_addr, sizeof(serv_addr)) < 0)
+	{
+		fprintf(stdout, "ERROR binding socket. Will retry. ERR=%u.\n\r", errno);
+		fflush(stdout);
+		close(fd);
+		return -1;
+	}
+
+	if (listen(fd, SOMAXCONN) < 0)
+	{
+		fprintf(stdout, "ERROR listening socket. Will retry. ERR=%u.\n\r", errno);
+		fflush(stdout);
+		close(fd);
+		return -1;
+	}
+
+	fprintf(stdout, "Socket successfully binded (worker %u).", worker->index);
+	return fd;
+}
+
+#if defined(CLI_TELNET_IO_URING)
+/*
+ * io_uring transport. Connections are taken with a multishot accept, input
+ * is received with multishot receives into a ring of provided buffers and
+ * the output of each session is sent as a chain of linked sends, so that
+ * the number of system calls follows the number of loop iterations and not
+ * the amount of data.
+ */
+
+/** @brief Submission queue entries of each worker ring */
+#define CLI_TELNET_URING_ENTRIES 256
+/** @brief Provided receive buffers of each worker, must be a power of 2 */
+#define CLI_TELNET_URING_BUFFERS 256
+/** @brief Size of each provided receive buffer */
+#define CLI_TELNET_URING_BUFFER_SIZE 2048
+/** @brief Buffer group of the provided receive buffers */
+#define CLI_TELNET_URING_GROUP 0
+/** @brief Most sends linked in the output chain of a session, one per block of its output queue */
+#define CLI_TELNET_URING_SENDS 16
+
+/** @brief Operation kinds, kept in the low bits of the user data next to the session pointer */
+#define CLI_TELNET_URING_ACCEPT 0
+#define CLI_TELNET_URING_RECV 1
+#define CLI_TELNET_URING_SEND 2
+#define CLI_TELNET_URING_WAKE 3
+#define CLI_TELNET_URING_KIND 3
+
+/** @brief io_uring instance of a worker */
+typedef struct cli_telnet_uring
+{
+	int fd; /**@brief Ring file descriptor */
+	void *sq_ptr; /**@brief Submission queue ring mapping */
+	size_t sq_len;
+	void *cq_ptr; /**@brief Completion queue ring mapping, may be sq_ptr */
+	size_t cq_len;
+	struct io_uring_sqe *sqes; /**@brief Submission queue entries mapping */
+	size_t sqes_len;
+	unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe *cqes;
+	unsigned sq_local_tail; /**@brief Entries prepared but not published yet */
+	struct io_uring_buf_ring *br; /**@brief Provided buffer ring */
+	size_t br_len;
+	char *buffers; /**@brief Memory of the provided buffers */
+	unsigned short br_tail;
+	cli_telnet_session_t *dirty; /**@brief Sessions with output or state to flush */
+} cli_telnet_uring_t;
+
+static int cli_telnet_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int cli_telnet_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int cli_telnet_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+	return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/**
+ * @brief Publish the prepared submission entries and enter the kernel
+ * @param ring: worker ring
+ * @param wait: number of completions to wait for
+ * @return 0 Success, -1 on failure
+ */
+static int cli_telnet_uring_submit(cli_telnet_uring_t *ring, unsigned wait)
+{
+	unsigned tail = *ring->sq_tail;
+	unsigned submit = ring->sq_local_tail - tail;
+	int r;
+
+	__atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+	do
+	{
+		r = cli_telnet_uring_enter(ring->fd, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0);
+	} while (r < 0 && errno == EINTR);
+
+	return r < 0 ? -1 : 0;
+}
+
+/**
+ * @brief Get a free submission entry, submitting the queue if it is full
+ * @param ring: worker ring
+ * @return Cleared submission entry
+ */
+static struct io_uring_sqe *cli_telnet_uring_sqe(cli_telnet_uring_t *ring)
+{
+	struct io_uring_sqe *sqe;
+	unsigned index;
+
+	while (ring->sq_local_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= CLI_TELNET_URING_ENTRIES)
+		cli_telnet_uring_submit(ring, 0);
+
+	index = ring->sq_local_tail & *ring->sq_mask;
+	sqe = &ring->sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	ring->sq_array[index] = index;
+	ring->sq_local_tail++;
+	return sqe;
+}
+
+/**
+ * @brief Give a receive buffer back to the kernel
+ * @param ring: worker ring
+ * @param bid: buffer id
+ */
+static void cli_telnet_uring_recycle(cli_telnet_uring_t *ring, unsigned short bid)
+{
+	struct io_uring_buf *buf;
+
+	buf = &ring->br->bufs[ring->br_tail & (CLI_TELNET_URING_BUFFERS - 1)];
+	buf->addr = (unsigned long) (ring->buffers + (size_t) bid * CLI_TELNET_URING_BUFFER_SIZE);
+	buf->len = CLI_TELNET_URING_BUFFER_SIZE;
+	buf->bid = bid;
+	ring->br_tail++;
+	__atomic_store_n(&ring->br->tail, ring->br_tail, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Release a worker ring
+ * @param ring: ring to be released
+ */
+static void cli_telnet_uring_delete(cli_telnet_uring_t *ring)
+{
+	if (ring->br)
+		munmap(ring->br, ring->br_len);
+	free(ring->buffers);
+	if (ring->sqes)
+		munmap(ring->sqes, ring->sqes_len);
+	if (ring->cq_ptr && ring->cq_ptr != ring->sq_ptr)
+		munmap(ring->cq_ptr, ring->cq_len);
+	if (ring->sq_ptr)
+		munmap(ring->sq_ptr, ring->sq_len);
+	if (ring->fd >= 0)
+		close(ring->fd);
+	free(ring);
+}
+
+/**
+ * @brief Create the ring of a worker, with its provided receive buffers
+ * @return Ring or NULL if io_uring (or one of the needed features) is not available
+ */
+static cli_telnet_uring_t *cli_telnet_uring_new(void)
+{
+	cli_telnet_uring_t *ring;
+	struct io_uring_params p;
+	struct io_uring_buf_reg reg;
+	unsigned i;
+
+	ring = calloc(1, sizeof(*ring));
+	if (!ring)
+		return NULL;
+
+	memset(&p, 0, sizeof(p));
+	ring->fd = cli_telnet_uring_setup(CLI_TELNET_URING_ENTRIES, &p);
+	if (ring->fd < 0 || !(p.features & IORING_FEAT_SINGLE_MMAP))
+		goto error;
+
+	ring->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	ring->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (ring->cq_len > ring->sq_len)
+		ring->sq_len = ring->cq_len;
+	ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+	IORING_OFF_SQ_RING);
+	if (ring->sq_ptr == MAP_FAILED)
+	{
+		ring->sq_ptr = NULL;
+		goto error;
+	}
+	ring->cq_ptr = ring->sq_ptr;
+
+	ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+	IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED)
+	{
+		ring->sqes = NULL;
+		goto error;
+	}
+
+	ring->sq_head = (unsigned *) ((char *) ring->sq_ptr + p.sq_off.head);
+	ring->sq_tail = (unsigned *) ((char *) ring->sq_ptr + p.sq_off.tail);
+	ring->sq_mask = (unsigned *) ((char *) ring->sq_ptr + p.sq_off.ring_mask);
+	ring->sq_array = (unsigned *) ((char *) ring->sq_ptr + p.sq_off.array);
+	ring->cq_head = (unsigned *) ((char *) ring->cq_ptr + p.cq_off.head);
+	ring->cq_tail = (unsigned *) ((char *) ring->cq_ptr + p.cq_off.tail);
+	ring->cq_mask = (unsigned *) ((char *) ring->cq_ptr + p.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *) ((char *) ring->cq_ptr + p.cq_off.cqes);
+	ring->sq_local_tail = *ring->sq_tail;
+
+	/* provided buffer ring, the kernel picks a buffer for each receive */
+	ring->br_len = CLI_TELNET_URING_BUFFERS * sizeof(struct io_uring_buf);
+	ring->br = mmap(NULL, ring->br_len, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+	if (ring->br == MAP_FAILED)
+	{
+		ring->br = NULL;
+		goto error;
+	}
+	ring->buffers = malloc((size_t) CLI_TELNET_URING_BUFFERS * CLI_TELNET_URING_BUFFER_SIZE);
+	if (!ring->buffers)
+		goto error;
+
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (unsigned long) ring->br;
+	reg.ring_entries = CLI_TELNET_URING_BUFFERS;
+	reg.bgid = CLI_TELNET_URING_GROUP;
+	if (cli_telnet_uring_register(ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+		goto error;
+
+	for (i = 0; i < CLI_TELNET_URING_BUFFERS; i++)
+		cli_telnet_uring_recycle(ring, i);
+
+	return ring;
+
+error:
+	cli_telnet_uring_delete(ring);
+	return NULL;
+}
+
+/**
+ * @brief Queue a multishot accept on the listening socket
+ * @param worker: worker owning the listening socket
+ */
+static void cli_telnet_uring_accept(cli_telnet_worker_t *worker)
+{
+	struct io_uring_sqe *sqe = cli_telnet_uring_sqe(worker->ring);
+
+	sqe->opcode = IORING_OP_ACCEPT;
+	sqe->fd = worker->sockfd;
+	sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+	/* like accept4(), the sends retry a full socket from the ring */
+	sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+	sqe->user_data = CLI_TELNET_URING_ACCEPT;
+}
+
+/**
+ * @brief Queue a poll of the wake up eventfd, completed by cli_telnet_deinit()
+ * @param worker: worker owning the eventfd
+ */
+static void cli_telnet_uring_wake(cli_telnet_worker_t *worker)
+{
+	struct io_uring_sqe *sqe = cli_telnet_uring_sqe(worker->ring);
+
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = worker->wake_fd;
+	sqe->poll32_events = POLLIN;
+	sqe->user_data = CLI_TELNET_URING_WAKE;
+}
+
+/**
+ * @brief Queue a multishot receive on a session, using the provided buffers
+ * @param session: session to receive from
+ */
+static void cli_telnet_uring_recv(cli_telnet_session_t *session)
+{
+	struct io_uring_sqe *sqe = cli_telnet_uring_sqe(session->worker->ring);
+
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = session->fd;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = CLI_TELNET_URING_GROUP;
+	sqe->user_data = (unsigned long) session | CLI_TELNET_URING_RECV;
+	session->recv_armed = true;
+}
+
+/**
+ * @brief List a session for the flush done at the end of the loop iteration
+ * @param session: session to be listed
+ */
+static void cli_telnet_uring_dirty(cli_telnet_session_t *session)
+{
+	if (!session->dirty)
+	{
+		session->dirty = true;
+		session->dirty_next = session->worker->ring->dirty;
+		session->worker->ring->dirty = session;
+	}
+}
+
+/**
+ * @brief tinyrl output function of io_uring sessions: nothing is taken,
+ *        the output stays in the queue of the editor and is sent from
+ *        there when the loop iteration ends
+ * @param context: session (cli_telnet_session_t)
+ * @param buf: data to be sent
+ * @param len: length of data
+ * @return -1 with errno set to EAGAIN
+ */
+static ssize_t cli_telnet_uring_write(void *context, const char *buf, size_t len)
+{
+	cli_telnet_uring_dirty(context);
+	errno = EAGAIN;
+	return -1;
+}
+
+/**
+ * @brief Submit the output queued by the editor of a session as one chain
+ *        of linked sends, straight from the blocks of the queue. They stay
+ *        in the queue until their send completes, and a new chain is only
+ *        started once the previous one has completed, which keeps the
+ *        output in order.
+ * @param session: session to flush
+ */
+static void cli_telnet_uring_send(cli_telnet_session_t *session)
+{
+	struct iovec iov[CLI_TELNET_URING_SENDS];
+	struct io_uring_sqe *sqe;
+	int count, i;
+
+	if (session->sending || session->send_failed)
+		return;
+
+	count = tinyrl__output_peek(session->t, iov, CLI_TELNET_URING_SENDS);
+	for (i = 0; i < count; i++)
+	{
+		sqe = cli_telnet_uring_sqe(session->worker->ring);
+		sqe->opcode = IORING_OP_SEND;
+		sqe->fd = session->fd;
+		sqe->addr = (unsigned long) iov[i].iov_base;
+		sqe->len = iov[i].iov_len;
+		sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+		sqe->user_data = (unsigned long) session | CLI_TELNET_URING_SEND;
+		if (i + 1 < count)
+			sqe->flags = IOSQE_IO_LINK;
+	}
+	session->sending = count;
+}
+
+/**
+ * @brief Start closing a session. It is released once its receive has
+ *        terminated and its output has been sent.
+ * @param session: session to close
+ */
+static void cli_telnet_uring_close(cli_telnet_session_t *session)
+{
+	if (!session->closing)
+	{
+		session->closing = true;
+		/* hand over what the editor still has queued */
+		tinyrl_flush(session->t);
+		/* terminates the multishot receive */
+		shutdown(session->fd, SHUT_RD);
+	}
+	cli_telnet_uring_dirty(session);
+}
+
+/**
+ * @brief Flush the sessions listed during the loop iteration: submit their
+ *        output, rearm their receive or release them
+ * @param ring: worker ring
+ */
+static void cli_telnet_uring_flush(cli_telnet_uring_t *ring)
+{
+	cli_telnet_session_t *session;
+
+	while ((session = ring->dirty))
+	{
+		ring->dirty = session->dirty_next;
+		session->dirty = false;
+
+		cli_telnet_uring_send(session);
+		if (!session->closing)
+		{
+			if (!session->recv_armed)
+				cli_telnet_uring_recv(session);
+		}
+		else if (!session->recv_armed && !session->sending)
 		{
-			/* Print in six columns. */
-			if (printed == 6)
+			cli_telnet_session_delete(session);
+		}
+	}
+}
+
+/**
+ * @brief Handle one completion
+ * @param worker: worker owning the ring
+ * @param cqe: completion entry
+ */
+static void cli_telnet_uring_complete(cli_telnet_worker_t *worker, struct io_uring_cqe *cqe)
+{
+	cli_telnet_uring_t *ring = worker->ring;
+	cli_telnet_session_t *session;
+	bool more = cqe->flags & IORING_CQE_F_MORE;
+
+	session = (cli_telnet_session_t *) (unsigned long) (cqe->user_data & ~(unsigned long long) CLI_TELNET_URING_KIND);
+	switch (cqe->user_data & CLI_TELNET_URING_KIND)
+	{
+	case CLI_TELNET_URING_ACCEPT:
+		if (cqe->res >= 0)
+		{
+			session = cli_telnet_session_new(worker, cqe->res);
+			if (session)
+			{
+				cli_telnet_uring_dirty(session);
+			}
+			else
 			{
-				printed = 0;
-				tinyrl_printf(this, "\n\r");
+				fprintf(stdout, "ERROR creating telnet session.\n\r");
+				fflush(stdout);
+				close(cqe->res);
 			}
-			tinyrl_printf(this, "%s\t\n\r", commands[i].name);
-			printed++;
 		}
-		tinyrl_printf(this, "\n\n\rTry `help [command]\' for more information.\n\r");
+		else
+		{
+			fprintf(stdout, "ERROR accepting connection from socket. ERR=%u.\n\r", -cqe->res);
+			fflush(stdout);
+		}
+		if (!more)
+			cli_telnet_uring_accept(worker);
+		break;
+
+	case CLI_TELNET_URING_RECV:
+		if (!more)
+			session->recv_armed = false;
+		if (cqe->flags & IORING_CQE_F_BUFFER)
+		{
+			unsigned short bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+
+			if (cqe->res > 0 && !session->closing
+			    && !cli_telnet_session_process(session,
+							   ring->buffers + (size_t) bid * CLI_TELNET_URING_BUFFER_SIZE, cqe->res))
+				cli_telnet_uring_close(session);
+			cli_telnet_uring_recycle(ring, bid);
+		}
+		if (cqe->res == 0 || (cqe->res < 0 && cqe->res != -ENOBUFS))
+			cli_telnet_uring_close(session);
+		/* out of buffers, the receive is rearmed by the flush */
+		cli_telnet_uring_dirty(session);
+		break;
+
+	case CLI_TELNET_URING_SEND:
+		session->sending--;
+		if (cqe->res > 0)
+			tinyrl__output_consume(session->t, cqe->res);
+		/* the sends linked after a short one are cancelled and sent again */
+		if (cqe->res < 0 && cqe->res != -ECANCELED)
+		{
+			session->send_failed = true;
+			cli_telnet_uring_close(session);
+		}
+		cli_telnet_uring_dirty(session);
+		break;
+
+	case CLI_TELNET_URING_WAKE:
+		/* cli_telnet_deinit(), the loop ends with this iteration */
+		break;
 	}
 }
 
 /**
- * @brief Quit application
- * @param this: data structure for a specific tinyrl instance
- * @param arg Not used
+ * @brief io_uring event loop of a worker
+ * @param worker: worker owning the ring and the listening socket
  */
-static void cli_telnet_command_quit(tinyrl_t * this, char *arg)
+static void cli_telnet_uring_loop(cli_telnet_worker_t *worker)
 {
-	int r;
+	cli_telnet_uring_t *ring = worker->ring;
+	unsigned head, tail;
 
+	cli_telnet_uring_accept(worker);
+	/* io_uring_enter() is no cancellation point, the ring is woken instead */
+	cli_telnet_uring_wake(worker);
 
-	r = close(this->sock_fd);
-	if (r != 0)
+	while (!__atomic_load_n(&worker->stop, __ATOMIC_ACQUIRE))
 	{
-		fprintf(stdout, "Fail closing telnet socket. ERR=%u.\n\r", r);
+		if (cli_telnet_uring_submit(ring, 1) < 0)
+		{
+			fprintf(stdout, "ERROR waiting for telnet events. ERR=%u.\n\r", errno);
+			fflush(stdout);
+			return;
+		}
+
+		head = *ring->cq_head;
+		tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+		while (head != tail)
+		{
+			cli_telnet_uring_complete(worker, &ring->cqes[head & *ring->cq_mask]);
+			head++;
+			__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+		}
+
+		cli_telnet_uring_flush(ring);
 	}
-	this->sock_fd = 0;
+}
+#endif /* CLI_TELNET_IO_URING */
 
-	fclose(this->istream);
-	fflush(stdout);
-	tinyrl_history_delete(this->history);
-	free(this);
-	this = NULL;
-	pthread_exit(NULL);
-	return;
+/**
+ * @brief  Telnet worker thread: opens its listening socket and runs its event loop
+ * @param  arg: worker (cli_telnet_worker_t) to run
+ * @return void *
+ */
+void* cli_telnet_thread(void * arg)
+{
+	cli_telnet_worker_t *worker = arg;
+
+	struct pollfd wake =
+	{ worker->wake_fd, POLLIN, 0 };
+
+	while ((worker->sockfd = cli_telnet_listen(worker)) < 0)
+	{
+		/* retry every second, unless cli_telnet_deinit() is waiting */
+		if (poll(&wake, 1, 1000) > 0)
+			return 0;
+	}
+
+#if defined(CLI_TELNET_IO_URING)
+	worker->ring = cli_telnet_uring_new();
+	if (worker->ring)
+	{
+		cli_telnet_uring_loop(worker);
+		while (worker->sessions)
+			cli_telnet_session_delete(worker->sessions);
+		/*
+		 * The ring is released in the background and its accept holds
+		 * the socket meanwhile: stop listening now, or the port shared
+		 * with SO_REUSEPORT keeps handing connections to this socket.
+		 */
+		shutdown(worker->sockfd, SHUT_RDWR);
+		cli_telnet_uring_delete(worker->ring);
+		worker->ring = NULL;
+		close(worker->sockfd);
+		worker->sockfd = -1;
+		return 0;
+	}
+	fprintf(stdout, "io_uring not available, using epoll (worker %u).", worker->index);
+#endif
+
+	worker->epoll_fd = epoll_create1(0);
+	if (worker->epoll_fd < 0)
+	{
+		fprintf(stdout, "ERROR creating telnet event loop. ERR=%u.\n\r", errno);
+		fflush(stdout);
+	}
+	else
+	{
+		cli_telnet_event_loop(worker);
+		while (worker->sessions)
+			cli_telnet_session_delete(worker->sessions);
+		close(worker->epoll_fd);
+		worker->epoll_fd = -1;
+	}
+	close(worker->sockfd);
+	worker->sockfd = -1;
+	return 0;
+}
+
+/**
+ * @brief Set the number of telnet workers started by cli_telnet_init()
+ * @param count: number of workers, 0 starts one per CPU the process may run on
+ */
+void cli_telnet_set_workers(unsigned count)
+{
+	cli_telnet_workers_requested = count;
 }
 
-static void cli_command_1(tinyrl_t * this, char *arg)
+/**
+ * @brief Choose between one history shared by all the telnet sessions (the
+ *        default) and a history of its own for each session
+ * @param shared: true to share the history
+ */
+void cli_telnet_set_shared_history(bool shared)
 {
-	tinyrl_printf(this, "You typed command 1");
-	return;
+	cli_telnet_history_private = !shared;
 }
-static void cli_command_2(tinyrl_t * this, char *arg)
+
+/**
+ * @brief Complete a word no command starts with to the commands holding its
+ *        characters in order, ranked (off by default)
+ * @param fuzzy: true to turn the fuzzy completion on
+ */
+void cli_telnet_set_fuzzy_completion(bool fuzzy)
 {
-	tinyrl_printf(this, "command 2!");
-	return;
+	cli_telnet_fuzzy = fuzzy;
+}
+
+/**
+ * @brief  Find the CPU a worker is pinned to
+ * @param  cpus: CPUs the process may run on
+ * @param  n: worker number, wraps around the CPUs
+ * @return CPU number
+ */
+static int cli_telnet_worker_cpu(const cpu_set_t *cpus, unsigned n)
+{
+	int cpu;
+
+	n %= CPU_COUNT(cpus);
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+		if (CPU_ISSET(cpu, cpus) && !n--)
+			break;
+	return cpu;
+}
+
+/**
+ * @brief Initialize cli telnet functions. Create the telnet worker threads,
+ *        each one pinned to its own CPU among those the process may run on
+ *        (taskset, cgroup cpuset). A worker which cannot be pinned runs
+ *        unpinned.
+ * @return 0 Success
+ */
+int cli_telnet_init()
+{
+	pthread_attr_t attr;
+	cpu_set_t allowed, cpus;
+	bool pin = true;
+	unsigned i;
+	int r = 0;
+
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || !CPU_COUNT(&allowed))
+	{
+		fprintf(stdout, "Fail getting CPU affinity, telnet workers not pinned. ERR=%u.", errno);
+		pin = false;
+		CPU_ZERO(&allowed);
+		CPU_SET(0, &allowed);
+	}
+
+	cli_telnet_workers_count = cli_telnet_workers_requested;
+	if (cli_telnet_workers_count == 0)
+		cli_telnet_workers_count = CPU_COUNT(&allowed);
+
+	cli_telnet_workers = calloc(cli_telnet_workers_count, sizeof(*cli_telnet_workers));
+	if (!cli_telnet_workers)
+	{
+		cli_telnet_workers_count = 0;
+		fprintf(stdout, "Fail allocating telnet workers.");
+		return ENOMEM;
+	}
+
+	if (!cli_telnet_history_private)
+	{
+		cli_telnet_history = tinyrl_history_shared_new(CLI_TELNET_HISTORY_SIZE);
+		if (!cli_telnet_history)
+			fprintf(stdout, "Fail allocating telnet history, sessions keep their own.");
+	}
+
+	for (i = 0; i < cli_telnet_workers_count; i++)
+	{
+		cli_telnet_worker_t *worker = &cli_telnet_workers[i];
+
+		worker->index = i;
+		worker->sockfd = -1;
+		worker->epoll_fd = -1;
+		worker->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		if (worker->wake_fd < 0)
+		{
+			r = errno;
+			fprintf(stdout, "Fail creating telnet wake up. ERR=%u.", r);
+			cli_telnet_workers_count = i;
+			break;
+		}
+
+		if (pin)
+		{
+			pthread_attr_init(&attr);
+			CPU_ZERO(&cpus);
+			CPU_SET(cli_telnet_worker_cpu(&allowed, i), &cpus);
+			r = pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+			/* Create CLI Telnet worker thread */
+			if (r == 0)
+				r = pthread_create(&worker->thread_id, &attr, &cli_telnet_thread, worker);
+			pthread_attr_destroy(&attr);
+			if (r != 0)
+				fprintf(stdout, "Fail pinning telnet worker %u, running it unpinned. ERR=%u.", i, r);
+		}
+		if (!pin || r != 0)
+			r = pthread_create(&worker->thread_id, NULL, &cli_telnet_thread, worker);
+		if (r != 0)
+		{
+			fprintf(stdout, "Fail creating thread. ERR=%u.", r);
+			close(worker->wake_fd);
+			cli_telnet_workers_count = i;
+			break;
+		}
+	}
+
+	return r;
+}
+
+/**
+ * @brief  Deinitialize cli telnet functions. The workers are woken up and
+ *         return from their event loop, rather than being cancelled in the
+ *         middle of a session.
+ * @return 0 Success
+ */
+int cli_telnet_deinit()
+{
+	const uint64_t one = 1;
+	unsigned i;
+	int r;
+
+	for (i = 0; i < cli_telnet_workers_count; i++)
+	{
+		cli_telnet_worker_t *worker = &cli_telnet_workers[i];
+
+		/* Stop CLI Telnet worker thread */
+		__atomic_store_n(&worker->stop, true, __ATOMIC_RELEASE);
+		if (write(worker->wake_fd, &one, sizeof(one)) != sizeof(one))
+		{
+			fprintf(stdout, "Fail waking telnet worker. ERR=%u.", errno);
+			continue;
+		}
+		/* the worker closes its sessions on its way out */
+		pthread_join(worker->thread_id, NULL);
+		close(worker->wake_fd);
+
+		if (worker->sockfd >= 0)
+		{
+			r = close(worker->sockfd);
+			if (r != 0)
+			{
+				fprintf(stdout, "Fail closing telnet socket. ERR=%u.\n\r", r);
+			}
+		}
+		if (worker->epoll_fd >= 0)
+			close(worker->epoll_fd);
+	}
+	free(cli_telnet_workers);
+	cli_telnet_workers = NULL;
+	cli_telnet_workers_count = 0;
+	tinyrl_history_shared_delete(cli_telnet_history);
+	cli_telnet_history = NULL;
+
+	fprintf(stdout, "Cli Telnet deinitialized.");
+	return 0;
 }
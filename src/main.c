@@ -38,6 +38,7 @@ int main(int argc, char **argv)
 		case INIT_CLI:
 			fprintf(stdout, "Initializing CLI.");
 			fflush(stdout);
+			cli_command_init();
 			cli_prompt_init();
 			cli_telnet_init();
 
@@ -70,6 +71,7 @@ int main(int argc, char **argv)
 			main_app_state = DEINIT_APP;
 			cli_telnet_deinit();
 			cli_prompt_deinit();
+			cli_command_deinit();
 
 			break;
 
@@ -110,3 +112,20 @@ void cli_quit_application(void)
 {
 	_cli_set_machine_state(QUIT_APP);
 }
+
+/**
+ * @brief Commands of the application, listed in cli_command_table.def
+ * @param this Line of the session
+ * @param argc Not used
+ * @param argv Not used
+ */
+void cli_command_1(tinyrl_t * this, int argc, const cli_token_t *argv)
+{
+	tinyrl_printf(this, "You typed command 1");
+	return;
+}
+void cli_command_2(tinyrl_t * this, int argc, const cli_token_t *argv)
+{
+	tinyrl_printf(this, "command 2!");
+	return;
+}
@@ -13,11 +13,16 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
 
 /* POSIX HEADERS */
 #include <termios.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
 
 #include "tinyrl.h"
 
@@ -30,10 +35,55 @@ struct tinyrl_keymap
 	void *context[KEYMAP_SIZE];
 };
 
+/* size of the blocks the output of non-tty instances is queued in */
+#define OUTPUT_CHUNK_SIZE 4096
+
+struct tinyrl_output_chunk
+{
+	struct tinyrl_output_chunk *next;
+	size_t len;		/* bytes queued in data */
+	size_t size;		/* bytes available in data */
+	char data[];
+};
+
+/*
+ * Output queue of non-tty instances. Everything printed is appended here
+ * and written with a single writev() per flush.
+ */
+struct tinyrl_output
+{
+	struct tinyrl_output_chunk *head;
+	struct tinyrl_output_chunk *tail;
+	struct tinyrl_output_chunk *spare;	/* kept to avoid a malloc per flush */
+	size_t sent;		/* bytes of head already written */
+	tinyrl_stats_t stats;
+};
+
+/* initial size of the redisplay frame buffers */
+#define FRAME_SIZE 256
+
+/* size of the reads made by tinyrl_readline() on non-tty input */
+#define INPUT_BUFFER_SIZE 4096
+
+/*
+ * Input read by tinyrl_readline() on non-tty instances. A read may bring
+ * several lines: whatever follows the end of a line is kept for the next
+ * call instead of being read again.
+ */
+struct tinyrl_input
+{
+	size_t start;		/* first byte not given to the editor yet */
+	size_t len;		/* bytes left from start */
+	char data[INPUT_BUFFER_SIZE];
+};
+
 #define ESCAPESEQ "\x1b["
 #define ESCAPE 27
 #define BACKSPACE 127
 
+static void tinyrl_bind_keyseq(tinyrl_t * this, const char *seq, tinyrl_key_func_t *handler, void *context);
+static bool tinyrl_extend_line_buffer(tinyrl_t * this, unsigned len);
+
 /*--------------------------------------------------------- */
 static void _tinyrl_vt100_setInputNonBlocking(const tinyrl_t * this)
 {
@@ -55,7 +105,7 @@ static void _tinyrl_vt100_setInputBlocking(const tinyrl_t * this)
 /*-------------------------------------------------------- */
 static void tinyrl_vt100_clear_screen(const tinyrl_t * this)
 {
-	tinyrl_printf(this, "\x1b[2J");
+	tinyrl_write(this, "\x1b[2J", 4);
 }
 
 /*-------------------------------------------------------- */
@@ -73,7 +123,7 @@ static void tinyrl_vt100_cursor_back(const tinyrl_t * this, unsigned count)
 /*-------------------------------------------------------- */
 static void tinyrl_vt100_cursor_home(const tinyrl_t * this)
 {
-	tinyrl_printf(this, "\x1b[H");
+	tinyrl_write(this, "\x1b[H", 3);
 }
 
 /*-------------------------------------------------------- */
@@ -82,6 +132,30 @@ static void tinyrl_vt100_erase(const tinyrl_t * this, unsigned count)
 	tinyrl_printf(this, "\x1b[%dP", count);
 }
 
+/*-------------------------------------------------------- */
+static void tinyrl_vt100_insert(const tinyrl_t * this, unsigned count)
+{
+	tinyrl_printf(this, "\x1b[%d@", count);
+}
+
+/*-------------------------------------------------------- */
+static void tinyrl_vt100_erase_down(const tinyrl_t * this)
+{
+	tinyrl_write(this, "\x1b[J", 3);
+}
+
+/*-------------------------------------------------------- */
+static void tinyrl_vt100_cursor_up(const tinyrl_t * this, unsigned count)
+{
+	tinyrl_printf(this, "\x1b[%dA", count);
+}
+
+/*-------------------------------------------------------- */
+static void tinyrl_vt100_cursor_down(const tinyrl_t * this, unsigned count)
+{
+	tinyrl_printf(this, "\x1b[%dB", count);
+}
+
 /*----------------------------------------------------------------------- */
 static void tty_set_raw_mode(tinyrl_t * this)
 {
@@ -120,16 +194,82 @@ static void tty_restore_mode(const tinyrl_t * this)
  It signals that if we are currently viewing a history line we should transfer it
  to the current buffer
  */
-static void changed_line(tinyrl_t * this)
+static bool changed_line(tinyrl_t * this)
 {
 	/* if the current line is not our buffer then make it so */
 	if (this->line != this->buffer)
 	{
-		/* replace the current buffer with the new details */
-		free(this->buffer);
-		this->line = this->buffer = strdup(this->line);
-		this->buffer_size = strlen(this->buffer);
-		assert(this->line);
+		const char *text = this->line;
+		unsigned len = strlen(text);
+
+		/* copy the new details into the buffer, keeping its storage */
+		if (!tinyrl_extend_line_buffer(this, len))
+			return false;
+		memcpy(this->buffer, text, len + 1);
+		this->line = this->buffer;
+		this->gap = len;
+	}
+	return true;
+}
+
+/*----------------------------------------------------------------------- */
+/*
+ * The line buffer is a gap buffer: the text before the gap is at the start
+ * of the buffer and the text after it at the end of the buffer. Edits are
+ * made at the gap, which is moved to the insertion point first; this only
+ * copies the text between the two, not the whole end of the line.
+ */
+static char *tinyrl_gap_tail(const tinyrl_t * this)
+{
+	return &this->buffer[this->buffer_size - (this->end - this->gap)];
+}
+
+/*----------------------------------------------------------------------- */
+static void tinyrl_gap_move(tinyrl_t * this, unsigned pos)
+{
+	char *tail = tinyrl_gap_tail(this);
+
+	if (pos < this->gap)
+	{
+		/* the text between pos and the gap joins the end */
+		memmove(tail - (this->gap - pos), &this->buffer[pos], this->gap - pos);
+	}
+	else if (pos > this->gap)
+	{
+		/* the start of the end joins the text before the gap */
+		memmove(&this->buffer[this->gap], tail, pos - this->gap);
+	}
+	this->gap = pos;
+}
+
+/*----------------------------------------------------------------------- */
+/*
+ * Return the line as a contiguous string, closing the gap if needed.
+ */
+static const char *tinyrl_line(tinyrl_t * this)
+{
+	if (this->line == this->buffer)
+	{
+		tinyrl_gap_move(this, this->end);
+		this->buffer[this->end] = '\0';
+	}
+	return this->line;
+}
+
+/*----------------------------------------------------------------------- */
+/*
+ * Copy the end characters of the line to dest, from both sides of the gap.
+ */
+static void tinyrl_copy_line(const tinyrl_t * this, char *dest)
+{
+	if (this->line == this->buffer)
+	{
+		memcpy(dest, this->buffer, this->gap);
+		memcpy(&dest[this->gap], tinyrl_gap_tail(this), this->end - this->gap);
+	}
+	else
+	{
+		memcpy(dest, this->line, this->end);
 	}
 }
 
@@ -193,7 +333,7 @@ static bool tinyrl_key_kill(void *context, int key)
 	free(this->kill_string);
 
 	/* store the killed string */
-	this->kill_string = strdup(&this->buffer[this->point]);
+	this->kill_string = strdup(&tinyrl_line(this)[this->point]);
 
 	/* delete the text to the end of the line */
 	tinyrl_delete_text(this, this->point, this->end);
@@ -327,17 +467,190 @@ static void tinyrl_keymap_free(struct tinyrl_keymap *keymap)
 
 }
 
+/*-------------------------------------------------------- */
+static struct tinyrl_output_chunk *tinyrl_output_chunk_new(struct tinyrl_output *output, size_t len)
+{
+	struct tinyrl_output_chunk *chunk;
+
+	if (output->spare && output->spare->size >= len)
+	{
+		chunk = output->spare;
+		output->spare = NULL;
+	}
+	else
+	{
+		if (len < OUTPUT_CHUNK_SIZE)
+			len = OUTPUT_CHUNK_SIZE;
+		chunk = malloc(sizeof(*chunk) + len);
+		if (!chunk)
+			return NULL;
+		chunk->size = len;
+	}
+	chunk->next = NULL;
+	chunk->len = 0;
+
+	if (output->tail)
+		output->tail->next = chunk;
+	else
+		output->head = chunk;
+	output->tail = chunk;
+	return chunk;
+}
+
+/*-------------------------------------------------------- */
+static void tinyrl_output_chunk_free(struct tinyrl_output *output, struct tinyrl_output_chunk *chunk)
+{
+	if (!output->spare && chunk->size == OUTPUT_CHUNK_SIZE)
+		output->spare = chunk;
+	else
+		free(chunk);
+}
+
+/*-------------------------------------------------------- */
+/*
+ * Append text to the output queue
+ */
+static bool tinyrl_output_append(struct tinyrl_output *output, const char *text, size_t len)
+{
+	struct tinyrl_output_chunk *chunk = output->tail;
+
+	if (!len)
+		return true;
+
+	output->stats.appends++;
+	if (chunk && chunk->size - chunk->len >= len)
+	{
+		memcpy(&chunk->data[chunk->len], text, len);
+		chunk->len += len;
+		return true;
+	}
+	if (chunk && chunk->len < chunk->size)
+	{
+		/* fill up the current chunk first */
+		size_t room = chunk->size - chunk->len;
+		memcpy(&chunk->data[chunk->len], text, room);
+		chunk->len += room;
+		text += room;
+		len -= room;
+	}
+	chunk = tinyrl_output_chunk_new(output, len);
+	if (!chunk)
+		return false;
+	memcpy(chunk->data, text, len);
+	chunk->len = len;
+	return true;
+}
+
+/*-------------------------------------------------------- */
+/*
+ * Format straight into the free space of the last chunk. If the result
+ * does not fit, a chunk large enough for it is added and the formatting
+ * done again there, so the output is never truncated.
+ */
+static int tinyrl_output_vprintf(struct tinyrl_output *output, const char *fmt, va_list args)
+{
+	struct tinyrl_output_chunk *chunk = output->tail;
+	size_t room = chunk ? chunk->size - chunk->len : 0;
+	va_list copy;
+	int len;
+
+	va_copy(copy, args);
+	len = vsnprintf(room ? &chunk->data[chunk->len] : NULL, room, fmt, copy);
+	va_end(copy);
+	if (len <= 0)
+		return len;
+
+	output->stats.appends++;
+	if ((size_t) len >= room)
+	{
+		/* leave space for the terminator vsnprintf() always writes */
+		chunk = tinyrl_output_chunk_new(output, (size_t) len + 1);
+		if (!chunk)
+			return -1;
+		vsnprintf(chunk->data, chunk->size, fmt, args);
+	}
+	chunk->len += len;
+	return len;
+}
+
+/*-------------------------------------------------------- */
+/*
+ * Describe the queued bytes not written yet in up to *count iovecs, set
+ * *count and *len to what has been described
+ * \return the first chunk left out, NULL if the whole queue is described
+ */
+static struct tinyrl_output_chunk *tinyrl_output_iov(const struct tinyrl_output *output,
+						     struct iovec *iov, int *count, size_t *len)
+{
+	struct tinyrl_output_chunk *chunk;
+	int i = 0;
+
+	*len = 0;
+	for (chunk = output->head; chunk && i < *count; chunk = chunk->next)
+	{
+		size_t skip = (i == 0) ? output->sent : 0;
+
+		iov[i].iov_base = chunk->data + skip;
+		iov[i].iov_len = chunk->len - skip;
+		*len += iov[i].iov_len;
+		i++;
+	}
+	*count = i;
+	return chunk;
+}
+
+/*-------------------------------------------------------- */
+/*
+ * Drop the first count queued bytes, after they have been written
+ */
+static void tinyrl_output_consume(struct tinyrl_output *output, size_t count)
+{
+	struct tinyrl_output_chunk *chunk;
+
+	output->stats.bytes += count;
+	while ((chunk = output->head) && count >= chunk->len - output->sent)
+	{
+		count -= chunk->len - output->sent;
+		output->sent = 0;
+		output->head = chunk->next;
+		if (!output->head)
+			output->tail = NULL;
+		tinyrl_output_chunk_free(output, chunk);
+	}
+	output->sent += count;
+}
+
+/*-------------------------------------------------------- */
+static void tinyrl_output_free(struct tinyrl_output *output)
+{
+	struct tinyrl_output_chunk *chunk;
+
+	while ((chunk = output->head))
+	{
+		output->head = chunk->next;
+		free(chunk);
+	}
+	free(output->spare);
+	free(output);
+}
+
 /*-------------------------------------------------------- */
 static void tinyrl_fini(tinyrl_t * this)
 {
 	/* free up any dynamic strings */
-	free(this->buffer);
+	if (this->buffer != this->inline_buffer)
+		free(this->buffer);
 	this->buffer = NULL;
 	free(this->kill_string);
 	this->kill_string = NULL;
-	free(this->last_buffer);
-	this->last_buffer = NULL;
+	free(this->frame[0].text);
+	free(this->frame[1].text);
+	this->last_frame = NULL;
 	tinyrl_keymap_free(this->keymap);
+	tinyrl_output_free(this->output);
+	this->output = NULL;
+	free(this->input);
+	this->input = NULL;
 }
 
 /*-------------------------------------------------------- */
@@ -362,12 +675,16 @@ static void tinyrl_init(tinyrl_t * this, FILE * instream, FILE * outstream)
 	tinyrl_bind_key(this, CTRL('Y'), tinyrl_key_yank, this);
 	tinyrl_bind_special(this, TINYRL_KEY_RIGHT, tinyrl_key_right, this);
 	tinyrl_bind_special(this, TINYRL_KEY_LEFT, tinyrl_key_left, this);
+	tinyrl_bind_keyseq(this, ESCAPESEQ "3~", tinyrl_key_delete, this);
 
 	this->line = NULL;
 	this->max_line_length = 0;
 	this->prompt = NULL;
-	this->buffer = NULL;
-	this->buffer_size = 0;
+	this->prompt_len = 0;
+	this->inline_buffer[0] = '\0';
+	this->buffer = this->inline_buffer;
+	this->gap = 0;
+	this->buffer_size = sizeof(this->inline_buffer) - 1;
 	this->done = false;
 	this->point = 0;
 	this->end = 0;
@@ -375,8 +692,25 @@ static void tinyrl_init(tinyrl_t * this, FILE * instream, FILE * outstream)
 	this->echo_char = '\0';
 	this->echo_enabled = true;
 	this->isatty = isatty(fileno(instream));
-	this->last_buffer = NULL;
+	this->frame[0].len = this->frame[1].len = 0;
+	this->frame[0].size = this->frame[1].size = FRAME_SIZE;
+	this->frame[0].text = malloc(FRAME_SIZE);
+	this->frame[1].text = malloc(FRAME_SIZE);
+	this->last_frame = NULL;
 	this->last_point = 0;
+	this->last_width = 0;
+	this->width = 0;
+	this->sock_fd = -1;
+	this->seq_keymap = NULL;
+	this->seq_handler = NULL;
+	this->seq_context = NULL;
+	this->seq_key = 0;
+	this->key_filter = NULL;
+	this->key_filter_context = NULL;
+	this->write_func = NULL;
+	this->write_context = NULL;
+	this->output = calloc(1, sizeof(*this->output));
+	this->input = NULL;
 
 	this->istream = instream;
 	this->ostream = outstream;
@@ -385,38 +719,125 @@ static void tinyrl_init(tinyrl_t * this, FILE * instream, FILE * outstream)
 /*-------------------------------------------------------- */
 int tinyrl_printf(const tinyrl_t * this, const char *fmt, ...)
 {
+	va_list args;
+	int len;
 
+	va_start(args, fmt);
 	if (this->isatty == 1)
 	{
-		va_list args;
-		int len;
-		va_start(args, fmt);
 		len = vfprintf(this->ostream, fmt, args);
-		va_end(args);
-
-		return len;
 	}
 	else
 	{
-		va_list args;
-		int len;
-		va_start(args, fmt);
+		len = tinyrl_output_vprintf(this->output, fmt, args);
+		if (len < 0)
+		{
+			fprintf(stdout, "Error queuing output.");
+		}
+	}
+	va_end(args);
 
-		char output_string[255];
-//		len = sprintf(output_string,fmt, args);
-		len = vsprintf(output_string, fmt, args);
-//		len = snprintf(output_string,255,fmt, args);
+	return len;
+}
+
+/*-------------------------------------------------------- */
+int tinyrl_write(const tinyrl_t * this, const char *text, size_t len)
+{
+	if (this->isatty == 1)
+	{
+		return fwrite(text, 1, len, this->ostream);
+	}
+	if (!tinyrl_output_append(this->output, text, len))
+	{
+		fprintf(stdout, "Error queuing output.");
+		return -1;
+	}
+	return len;
+}
+
+/*-------------------------------------------------------- */
+int tinyrl_flush(const tinyrl_t * this)
+{
+	struct tinyrl_output *output = this->output;
+	struct tinyrl_output_chunk *chunk;
+	struct iovec iov[64];
+	int fd = fileno(this->ostream);
+	int count;
+	size_t len;
+	ssize_t r;
+
+	if (this->isatty == 1)
+		return fflush(this->ostream);
+
+	if (!output->head)
+		return 0;
+	output->stats.flushes++;
+
+	while (output->head)
+	{
+		/* gather as much of the queue as a single call takes */
+		count = sizeof(iov) / sizeof(iov[0]);
+		chunk = tinyrl_output_iov(output, iov, &count, &len);
+
+		if (this->write_func)
+		{
+			/* the transport takes one fragment at a time */
+			r = this->write_func(this->write_context, iov[0].iov_base, iov[0].iov_len);
+			len = iov[0].iov_len;
+		}
+		else
+		{
+			struct msghdr msg;
+
+			memset(&msg, 0, sizeof(msg));
+			msg.msg_iov = iov;
+			msg.msg_iovlen = count;
+			/* tell the stack when more data is following straight away */
+			r = sendmsg(fd, &msg, MSG_NOSIGNAL | (chunk ? MSG_MORE : 0));
+			if (r < 0 && errno == ENOTSOCK)
+				r = writev(fd, iov, count);
+			output->stats.syscalls++;
+		}
 
-		int r;
-		r = write(fileno(this->ostream), output_string, strlen(output_string));
 		if (r < 0)
 		{
-			fprintf(stdout, "Error writing. ERR=%u.", r);
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return TINYRL_FLUSH_PENDING;
+			fprintf(stdout, "Error writing. ERR=%u.", errno);
+			return -1;
 		}
-//		va_end(args);
-		return len;
+		tinyrl_output_consume(output, r);
+		/* the socket is full, the next call would only fail with EAGAIN */
+		if ((size_t) r < len)
+			return TINYRL_FLUSH_PENDING;
 	}
+	return 0;
+}
+
+/*-------------------------------------------------------- */
+int tinyrl__output_peek(const tinyrl_t * this, struct iovec *iov, int count)
+{
+	size_t len;
 
+	if (this->isatty == 1)
+		return 0;
+	tinyrl_output_iov(this->output, iov, &count, &len);
+	return count;
+}
+
+/*-------------------------------------------------------- */
+void tinyrl__output_consume(const tinyrl_t * this, size_t len)
+{
+	if (this->isatty != 1)
+		tinyrl_output_consume(this->output, len);
+}
+
+/*-------------------------------------------------------- */
+const tinyrl_stats_t *tinyrl__get_stats(const tinyrl_t * this)
+{
+	return &this->output->stats;
 }
 
 /*-------------------------------------------------------- */
@@ -425,6 +846,9 @@ void tinyrl_delete(tinyrl_t * this)
 	assert(this);
 	if (this)
 	{
+		/* send what is still queued */
+		tinyrl_flush(this);
+
 		/* let the object tidy itself up */
 		tinyrl_fini(this);
 
@@ -439,193 +863,242 @@ void tinyrl_delete(tinyrl_t * this)
  * EXPORTED INTERFACE
  *##################################### */
 /*----------------------------------------------------------------------- */
+/*
+ * A thread reading lines may be cancelled while it waits for input, never
+ * in the middle of an edit or of a command, which may hold locks.
+ */
 static int tinyrl_getchar(const tinyrl_t * this)
 {
-	return getc(this->istream);
+	int key, state;
+
+	pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &state);
+	key = getc(this->istream);
+	pthread_setcancelstate(state, NULL);
+	return key;
 }
 
 /*----------------------------------------------------------------------- */
-static void tinyrl_internal_print(const tinyrl_t * this, const char *text)
+/*
+ * Make room for len characters and the null in a frame buffer. Buffers
+ * only grow, by doubling, so redisplay allocates nothing once the longest
+ * line has been seen.
+ */
+static bool tinyrl_frame_reserve(struct tinyrl_frame *frame, size_t len)
 {
-	if (this->echo_enabled)
+	size_t size = frame->size;
+	char *text;
+
+	if (frame->text && len < size)
+		return true;
+	while (size <= len)
+		size *= 2;
+	text = realloc(frame->text, size);
+	if (!text)
+		return false;
+	frame->text = text;
+	frame->size = size;
+	return true;
+}
+
+/*----------------------------------------------------------------------- */
+/*
+ * Move the cursor between two positions of the displayed frame, counted
+ * from the start of the prompt; the frame wraps every width columns. Short
+ * moves use a carriage return, backspaces or reprint the characters, which
+ * is fewer bytes than an escape sequence.
+ */
+static void tinyrl_redisplay_move(const tinyrl_t * this, const char *frame,
+				  unsigned width, unsigned from, unsigned to)
+{
+	unsigned from_row = from / width, from_col = from % width;
+	unsigned to_row = to / width, to_col = to % width;
+
+	if (to_row < from_row)
+		tinyrl_vt100_cursor_up(this, from_row - to_row);
+	else if (to_row > from_row)
+		tinyrl_vt100_cursor_down(this, to_row - from_row);
+
+	if (to_col < from_col)
 	{
-		/* simply echo the line */
-		if (this->isatty == 1)
-		{
-			tinyrl_printf(this, "%s", text);
-		}
+		if (!to_col)
+			tinyrl_write(this, "\r", 1);
+		else if (from_col - to_col < 4)
+			tinyrl_write(this, "\b\b\b", from_col - to_col);
 		else
-		{
-			tinyrl_printf(this, text);
-		}
+			tinyrl_vt100_cursor_back(this, from_col - to_col);
 	}
-	else
+	else if (to_col > from_col)
 	{
-		/* replace the line with echo char if defined */
-		if (this->echo_char)
-		{
-			unsigned i = strlen(text);
-			while (i--)
-			{
-				tinyrl_printf(this, "%c", this->echo_char);
-			}
-		}
+		if (to_col - from_col < 4)
+			tinyrl_write(this, &frame[to - (to_col - from_col)], to_col - from_col);
+		else
+			tinyrl_vt100_cursor_forward(this, to_col - from_col);
 	}
 }
 
 /*----------------------------------------------------------------------- */
+/*
+ * After printing up to the last column of a row the terminal leaves the
+ * cursor there until the next character arrives. Move it to the start of
+ * the next row, where the frame positions expect it.
+ */
+static void tinyrl_redisplay_wrap(const tinyrl_t * this, unsigned width, unsigned pos)
+{
+	if (pos && !(pos % width))
+		tinyrl_write(this, " \b", 2);
+}
+
+/*----------------------------------------------------------------------- */
+/*
+ * Update the display from the previous frame to the current one.
+ *
+ * The frame is the prompt followed by the line as it is displayed, with
+ * every character replaced by the echo char when echo is disabled. The
+ * frame previously sent is kept as a model of the screen: together with
+ * the terminal width it tells on which row and column each character and
+ * the cursor are, so lines wrapped over several rows are updated in place.
+ *
+ * Only the characters after the unchanged start of the frame are printed.
+ * While the frame fits on one row the terminal inserts or deletes
+ * characters to keep the unchanged end in place; otherwise everything up
+ * to the end is printed again.
+ */
 void tinyrl_redisplay(tinyrl_t * this)
 {
-	int delta;
-	unsigned line_len, last_line_len, count;
-	line_len = strlen(this->line);
-	last_line_len = (this->last_buffer ? strlen(this->last_buffer) : 0);
+	const struct tinyrl_frame *last_frame = this->last_frame;
+	struct tinyrl_frame *next_frame;
+	const char *last = last_frame ? last_frame->text : NULL;
+	unsigned width = tinyrl__get_width(this);
+	unsigned prompt_len = this->prompt_len;
+	unsigned line_len = this->end;
+	unsigned frame_len, last_len, point, prefix, suffix, old_count, new_count;
+	char *frame;
+
+	if (!this->echo_enabled && !this->echo_char)
+	{
+		/* nothing of the line is displayed */
+		line_len = 0;
+	}
+	frame_len = prompt_len + line_len;
+	point = prompt_len + (line_len ? this->point : 0);
+
+	/* build the frame in the buffer not on the screen */
+	next_frame = (last_frame == &this->frame[0]) ? &this->frame[1] : &this->frame[0];
+	if (!tinyrl_frame_reserve(next_frame, frame_len))
+		return;
+	frame = next_frame->text;
+	next_frame->len = frame_len;
+	memcpy(frame, this->prompt, prompt_len);
+	if (this->echo_enabled)
+		tinyrl_copy_line(this, &frame[prompt_len]);
+	else
+		memset(&frame[prompt_len], this->echo_char, line_len);
+	frame[frame_len] = '\0';
+
+	if (last && width != this->last_width
+	    && (last_frame->len >= width || last_frame->len >= this->last_width))
+	{
+		/* the terminal has been resized under a wrapped frame, draw it
+		   again from the first row */
+		if (this->last_point / this->last_width)
+			tinyrl_vt100_cursor_up(this, this->last_point / this->last_width);
+		tinyrl_write(this, "\r\x1b[J", 4);
+		last = NULL;
+	}
 
-	do
+	if (!last)
 	{
-		if (this->last_buffer)
+		/* simply display the prompt and the line */
+		if (!this->isatty)
+			tinyrl_write(this, "\r\x1b[0K", 5);
+		tinyrl_write(this, frame, frame_len);
+		tinyrl_redisplay_wrap(this, width, frame_len);
+
+		/* move the cursor to the insertion point */
+		tinyrl_redisplay_move(this, frame, width, frame_len, point);
+	}
+	else
+	{
+		last_len = last_frame->len;
+
+		/* find the parts left untouched */
+		for (prefix = 0; prefix < frame_len && prefix < last_len; prefix++)
+		{
+			if (frame[prefix] != last[prefix])
+				break;
+		}
+		for (suffix = 0; prefix + suffix < frame_len && prefix + suffix < last_len; suffix++)
+		{
+			if (frame[frame_len - 1 - suffix] != last[last_len - 1 - suffix])
+				break;
+		}
+		old_count = last_len - prefix - suffix;
+		new_count = frame_len - prefix - suffix;
+
+		if (!old_count && !new_count)
 		{
-			delta = (int) (line_len - last_line_len);
-			if (delta > 0)
+			/* same content, move the point */
+			tinyrl_redisplay_move(this, frame, width, this->last_point, point);
+		}
+		else if (last_len < width && frame_len < width)
+		{
+			tinyrl_redisplay_move(this, frame, width, this->last_point, prefix);
+
+			/* overwrite what both frames have in the changed part */
+			tinyrl_write(this, &frame[prefix], old_count < new_count ? old_count : new_count);
+			if (new_count > old_count)
 			{
-				count = (unsigned) delta;
-				/* is the current line simply an extension of the previous one? */
-				if (0 == strncmp(this->line, this->last_buffer, last_line_len))
-				{
-					/* output the line accounting for the echo behaviour */
-					if (this->isatty == 1)
-					{
-						tinyrl_internal_print(this, &this->line[line_len - count]);
-					}
-					else
-					{
-						tinyrl_internal_print(this, "\r\x1b[0K");
-						tinyrl_internal_print(this, this->prompt);
-						tinyrl_internal_print(this, this->line);
-					}
-					break;
-				}
+				/* make room for the rest unless it goes at the end */
+				if (suffix)
+					tinyrl_vt100_insert(this, new_count - old_count);
+				tinyrl_write(this, &frame[prefix + old_count], new_count - old_count);
 			}
-			else if (delta < 0)
+			else if (old_count > new_count)
 			{
-				/* is the current line simply a deletion of some characters from the end? */
-				if (0 == strncmp(this->line, this->last_buffer, line_len))
-				{
-					if (this->echo_enabled || this->echo_char)
-					{
-						int shift = (int) (this->last_point - this->point);
-						/* just get the terminal to delete the characters */
-						if (shift > 0)
-						{
-							/* we've moved the cursor backwards */
-							if (this->isatty == 0)
-							{
-//								tinyrl_printf(this,this->buffer);
-								tinyrl_internal_print(this, "\r\x1b[0K");
-								tinyrl_internal_print(this, this->prompt);
-								tinyrl_internal_print(this, this->line);
-							}
-							else
-							{
-								count = (unsigned) shift;
-								tinyrl_vt100_cursor_back(this, count);
-							}
-						}
-						else if (shift < 0)
-						{
-							if (this->isatty == 1)
-							{
-								count = (unsigned) -shift;
-								/* we've moved the cursor forwards */
-								tinyrl_vt100_cursor_forward(this, count);
-							}
-						}
-						if (this->isatty == 1)
-						{
-							/* now delete the characters */
-							count = (unsigned) -delta;
-							tinyrl_vt100_erase(this, count);
-						}
-					}
-					break;
-				}
-			}
-			else
-			{
-				/* are the lines are the same content? */
-				if (0 == strcmp(this->line, this->last_buffer))
-				{
-					if (this->echo_enabled || this->echo_char)
-					{
-						delta = (int) (this->point - this->last_point);
-						if (delta > 0)
-						{
-							count = (unsigned) delta;
-							/* move the point forwards */
-							tinyrl_vt100_cursor_forward(this, count);
-						}
-						else if (delta < 0)
-						{
-							count = (unsigned) -delta;
-							/* move the cursor backwards */
-							tinyrl_vt100_cursor_back(this, count);
-						}
-					}
-					/* done for now */
-					break;
-				}
+				/* now delete the characters */
+				tinyrl_vt100_erase(this, old_count - new_count);
 			}
+			tinyrl_redisplay_move(this, frame, width, prefix + new_count, point);
 		}
 		else
 		{
-			/* simply display the prompt and the line */
-			if (this->isatty == 1)
+			/* rows are not shifted by the terminal, print up to the end */
+			tinyrl_redisplay_move(this, frame, width, this->last_point, prefix);
+			if (frame_len > prefix)
 			{
-				tinyrl_printf(this, "%s", this->prompt);
-				tinyrl_internal_print(this, this->line);
+				tinyrl_write(this, &frame[prefix], frame_len - prefix);
+				tinyrl_redisplay_wrap(this, width, frame_len);
 			}
-			else
-			{
-				tinyrl_internal_print(this, "\r\x1b[0K");
-				tinyrl_internal_print(this, this->prompt);
-				tinyrl_internal_print(this, this->line);
-			}
-
-			if (this->point < line_len)
+			if (last_len > frame_len)
 			{
-				/* move the cursor to the insertion point */
-				tinyrl_vt100_cursor_back(this, line_len - this->point);
+				/* erase what is left of the previous frame */
+				tinyrl_vt100_erase_down(this);
 			}
-			break;
+			tinyrl_redisplay_move(this, frame, width, frame_len, point);
 		}
-		/*
-		 * to have got this far we must have edited the middle of a line.
-		 */
-		if (this->last_point)
-		{
-			/* move to just after the prompt of the line */
-			tinyrl_vt100_cursor_back(this, this->last_point);
-		}
-		/* erase the previous line */
-		tinyrl_vt100_erase(this, strlen(this->last_buffer));
+	}
 
-		/* output the line accounting for the echo behaviour */
-		tinyrl_internal_print(this, this->line);
+	/* the frame now on the screen, the other buffer is free for the next */
+	this->last_frame = next_frame;
+	this->last_point = point;
+	this->last_width = width;
+}
 
-		delta = (int) (line_len - this->point);
-		if (delta)
-		{
-			/* move the cursor back to the insertion point */
-			tinyrl_vt100_cursor_back(this, (strlen(this->line) - this->point));
-		}
-	} /*lint -e717 */while (0) /*lint +e717 */
-	;
+/*----------------------------------------------------------------------- */
+/*
+ * Leave the cursor after the last row of a wrapped frame, so that output
+ * starting on the next line does not land on the rows of the frame.
+ */
+static void tinyrl_redisplay_park(tinyrl_t * this)
+{
+	const struct tinyrl_frame *frame = this->last_frame;
 
-	/* update the display */
-	/* set up the last line buffer */
-	free(this->last_buffer);
-	this->last_buffer = strdup(this->line);
-	this->last_point = this->point;
+	if (frame && frame->len >= this->last_width)
+	{
+		tinyrl_redisplay_move(this, frame->text, this->last_width,
+				      this->last_point, frame->len);
+		this->last_point = frame->len;
+	}
 }
 
 /*----------------------------------------------------------------------- */
@@ -647,101 +1120,224 @@ tinyrl_t *tinyrl_new(FILE * instream, FILE * outstream)
  * Note: if there is a partial match, then the extra keys are discarded.  This
  * shouldn't matter in practice.
  */
-static void tinyrl_handle_key(tinyrl_t *this, int key)
+static void tinyrl_dispatch_key(tinyrl_t *this)
 {
-	struct tinyrl_keymap *keymap;
-	tinyrl_key_func_t *handler;
-	void *context;
-	int c;
+	tinyrl_key_func_t *handler = this->seq_handler;
+	void *context = this->seq_context;
 
-	handler = NULL;
-	context = NULL;
-	keymap = this->keymap;
-	c = key;
-	for (;;)
-	{
-		if (keymap->handler[c])
-		{
-			handler = keymap->handler[c];
-			context = keymap->context[c];
-		}
-		keymap = keymap->keymap[c];
-		if (!keymap)
-			break;
-
-		_tinyrl_vt100_setInputNonBlocking(this);
-		c = getc(this->istream);
-		_tinyrl_vt100_setInputBlocking(this);
-		if (c == EOF)
-			break;
-	}
+	this->seq_keymap = NULL;
+	this->seq_handler = NULL;
+	this->seq_context = NULL;
 
-	if (!handler || !handler(context, key))
+	if (!handler || !handler(context, this->seq_key))
 	{
 		/* an issue has occured */
 		tinyrl_ding(this);
 	}
 }
 
-char *tinyrl_readline(tinyrl_t * this, const char *prompt)
+/*----------------------------------------------------------------------- */
+/*
+ * Offer a complete key to the key filter, if there is one. Returns true if
+ * the filter took the key, which is then not dispatched.
+ */
+static bool tinyrl_filter_key(tinyrl_t *this)
+{
+	if (!this->key_filter || !this->key_filter(this->key_filter_context, this->seq_key))
+		return false;
+
+	this->seq_keymap = NULL;
+	this->seq_handler = NULL;
+	this->seq_context = NULL;
+	return true;
+}
+
+/*----------------------------------------------------------------------- */
+/*
+ * Advance the key sequence state by one input byte. Returns true once
+ * the byte cannot extend the sequence any further and the key is ready to
+ * be dispatched.
+ */
+static bool tinyrl_handle_key(tinyrl_t *this, unsigned char c)
+{
+	struct tinyrl_keymap *keymap = this->seq_keymap;
+
+	if (!keymap)
+	{
+		/* start of a new key sequence */
+		keymap = this->keymap;
+		this->seq_key = c;
+		this->seq_handler = NULL;
+		this->seq_context = NULL;
+	}
+	if (keymap->handler[c])
+	{
+		this->seq_handler = keymap->handler[c];
+		this->seq_context = keymap->context[c];
+	}
+	this->seq_keymap = keymap->keymap[c];
+	return !this->seq_keymap;
+}
+
+/*----------------------------------------------------------------------- */
+/*
+ * Handlers which only edit the line and print nothing themselves, so their
+ * redisplay may be put off until more keys have been handled.
+ */
+static bool tinyrl_key_is_quiet(tinyrl_key_func_t *handler)
+{
+	return handler == tinyrl_key_default
+	    || handler == tinyrl_key_start_of_line
+	    || handler == tinyrl_key_end_of_line
+	    || handler == tinyrl_key_kill
+	    || handler == tinyrl_key_yank
+	    || handler == tinyrl_key_left
+	    || handler == tinyrl_key_right
+	    || handler == tinyrl_key_backspace
+	    || handler == tinyrl_key_delete
+	    || handler == tinyrl_key_erase_line
+	    || handler == tinyrl_history_key_up
+	    || handler == tinyrl_history_key_down
+	    || handler == tinyrl_history_key_search;
+}
+
+/*----------------------------------------------------------------------- */
+tinyrl_feed_t tinyrl_feed(tinyrl_t * this, const char *bytes, size_t len, size_t *consumed)
+{
+	size_t i = 0;
+	bool stale = false;	/* the line has changed since the last redisplay */
+
+	while (i < len && !this->done)
+	{
+		if (!tinyrl_handle_key(this, (unsigned char) bytes[i++]))
+			continue;
+
+		if (this->key_filter)
+		{
+			/* the filter may change the line even if it passes the key on */
+			stale = true;
+			if (tinyrl_filter_key(this))
+				continue;
+		}
+
+		/*
+		 * All the keys of the chunk are handled before the line is
+		 * redisplayed once, unless a handler which may print (enter,
+		 * completion...) needs the screen up to date first.
+		 */
+		if (!tinyrl_key_is_quiet(this->seq_handler))
+		{
+			if (stale)
+				tinyrl_redisplay(this);
+			tinyrl_redisplay_park(this);
+		}
+		tinyrl_dispatch_key(this);
+		stale = true;
+
+		if (this->done)
+		{
+			/*
+			 * If the last character in the line (other than
+			 * the null) is a space remove it.
+			 */
+			if (this->end && isspace(tinyrl_line(this)[this->end - 1]))
+			{
+				tinyrl_delete_text(this, this->end - 1, this->end);
+			}
+		}
+	}
+
+	/* update the display */
+	if (stale && !this->done)
+		tinyrl_redisplay(this);
+
+	/* one write for everything the chunk caused */
+	tinyrl_flush(this);
+
+	if (consumed)
+		*consumed = i;
+	return this->done ? TINYRL_FEED_LINE : TINYRL_FEED_MORE;
+}
+
+/*----------------------------------------------------------------------- */
+void tinyrl_readline_begin(tinyrl_t * this, const char *prompt)
 {
 	/* initialise for reading a line */
 	this->done = false;
 	this->point = 0;
 	this->end = 0;
-	this->buffer = strdup("");
-	this->buffer_size = strlen(this->buffer);
+	/* the buffer keeps the capacity reached by the previous lines */
+	this->buffer[0] = '\0';
 	this->line = this->buffer;
+	this->gap = 0;
 	this->prompt = prompt;
+	this->prompt_len = strlen(prompt);
+	this->seq_keymap = NULL;
+	this->key_filter = NULL;
+	this->key_filter_context = NULL;
 
+	tinyrl_reset_line_state(this);
+	tinyrl_flush(this);
+}
+
+/*----------------------------------------------------------------------- */
+char *tinyrl_readline_end(tinyrl_t * this)
+{
+	const char *line = tinyrl_line(this);
+
+	return line ? strdup(line) : NULL;
+}
+
+/*----------------------------------------------------------------------- */
+char *tinyrl_readline(tinyrl_t * this, const char *prompt)
+{
 	if (this->isatty)
 	{
 		/* set the terminal into raw input mode */
 		tty_set_raw_mode(this);
 
-		tinyrl_reset_line_state(this);
+		tinyrl_readline_begin(this, prompt);
 
 		while (!this->done)
 		{
-			int key;
-			/* update the display */
-			tinyrl_redisplay(this);
+			char c;
 			/* get a key */
-			key = tinyrl_getchar(this);
-			/* has the input stream terminated? */
+			int key = tinyrl_getchar(this);
 
-			if (EOF != key)
-			{
-				/* call the handler for this key */
-				tinyrl_handle_key(this, key);
-
-				if (this->done)
-				{
-					/*
-					 * If the last character in the line (other than 
-					 * the null) is a space remove it.
-					 */
-					if (this->end && isspace(this->line[this->end - 1]))
-					{
-						tinyrl_delete_text(this, this->end - 1, this->end);
-					}
-				}
-			}
-			else
+			/* has the input stream terminated? */
+			if (EOF == key)
 			{
 				/* time to finish the session */
 				this->done = true;
 				this->line = NULL;
+				break;
+			}
+			c = key;
+			tinyrl_feed(this, &c, 1, NULL);
+
+			/* finish a key sequence with whatever is already available */
+			while (this->seq_keymap)
+			{
+				_tinyrl_vt100_setInputNonBlocking(this);
+				key = tinyrl_getchar(this);
+				_tinyrl_vt100_setInputBlocking(this);
+				if (EOF == key)
+				{
+					clearerr(this->istream);
+					if (!tinyrl_filter_key(this))
+						tinyrl_dispatch_key(this);
+					if (!this->done)
+						tinyrl_redisplay(this);
+					break;
+				}
+				c = key;
+				tinyrl_feed(this, &c, 1, NULL);
 			}
 		}
 		/* restores the terminal mode */
 		tty_restore_mode(this);
 		{
-			char *result = this->line ? strdup(this->line) : NULL;
-
-			/* free our internal buffer */
-			free(this->buffer);
-			this->buffer = NULL;
+			char *result = tinyrl_readline_end(this);
 
 			if ((NULL == result) || '\0' == *result)
 			{
@@ -753,63 +1349,41 @@ char *tinyrl_readline(tinyrl_t * this, const char *prompt)
 	}
 	else
 	{
-		char c[8];
-		free(this->last_buffer);
-		this->last_buffer = NULL;
-		write(fileno(this->ostream), this->prompt, strlen(this->prompt));
+		struct tinyrl_input *input = this->input;
+		tinyrl_feed_t result;
+		size_t used;
+		ssize_t len;
 
-		bzero(c, 7);
-		while (this->sock_fd != 0 && (read(fileno(this->istream), &c, 8) > 0))
+		if (!input)
 		{
-			regex_t start_state;
-			/* Handles letters, numbers, space, backspace, enter, arrow keyes and delete */
-			regcomp(&start_state, "[a-zA-Z0-9. _\t\n\r\177\?]", REG_EXTENDED);
-			if (regexec(&start_state, c, 0, NULL, 0) == 0 && c >= 0)
-			{
-				if (strlen(c) > 1)
-				{
-					if (c[2] == 65)
-					{ //arrow up
-						tinyrl_history_key_up(this->history, TINYRL_KEY_UP);
-					}
-					else if (c[2] == 66)
-					{ // arrow down
-						tinyrl_history_key_down(this->history, TINYRL_KEY_DOWN);
-					}
-					else if (c[2] == 67)
-					{ //arrow right
-						tinyrl_key_right(this, *c);
-					}
-					else if (c[2] == 68)
-					{ // arrow left
-						tinyrl_key_left(this, *c);
-					}
-					else if (c[2] == 51 && c[3] == 126)
-					{
-						tinyrl_key_delete(this, *c);
-					}
-				}
-				else
-				{
-					tinyrl_handle_key(this, *c);
-				}
-				if (*c == 13)
-				{
+			input = this->input = malloc(sizeof(*input));
+			if (!input)
+				return 0;
+			input->start = 0;
+			input->len = 0;
+		}
 
-					char *result = this->line ? strdup(this->line) : NULL;
-					/* free our internal buffer */
-					bzero(this->buffer, 32);
-					/* make sure we're not left on a prompt line */
-					tinyrl_crlf(this);
-					return result;
+		tinyrl_readline_begin(this, prompt);
 
-				}
-				else
-				{
-					tinyrl_redisplay(this);
-				}
+		while (this->sock_fd != 0)
+		{
+			if (!input->len)
+			{
+				int state;
+
+				pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &state);
+				len = read(fileno(this->istream), input->data, sizeof(input->data));
+				pthread_setcancelstate(state, NULL);
+				if (len <= 0)
+					break;
+				input->start = 0;
+				input->len = len;
 			}
-			bzero(c, 7);
+			result = tinyrl_feed(this, input->data + input->start, input->len, &used);
+			input->start += used;
+			input->len -= used;
+			if (TINYRL_FEED_LINE == result)
+				return tinyrl_readline_end(this);
 		}
 	}
 	return 0;
@@ -823,67 +1397,61 @@ char *tinyrl_readline(tinyrl_t * this, const char *prompt)
  */
 static bool tinyrl_extend_line_buffer(tinyrl_t * this, unsigned len)
 {
-	bool result = true;
-	if (this->buffer_size < len)
-	{
-		char *new_buffer;
-		size_t new_len = len;
+	char *new_buffer;
+	size_t new_size;
+	unsigned tail = (this->line == this->buffer) ? this->end - this->gap : 0;
 
-		/* 
-		 * What we do depends on whether we are limited by
-		 * memory or a user imposed limit.
-		 */
-
-		if (this->max_line_length == 0)
-		{
-			if (new_len < this->buffer_size + 10)
-			{
-				/* make sure we don't realloc too often */
-				new_len = this->buffer_size + 10;
-			}
-			/* leave space for terminator */
-			new_buffer = realloc(this->buffer, new_len + 1);
-
-			if (NULL == new_buffer)
-			{
-				tinyrl_ding(this);
-				result = false;
-			}
-			else
-			{
-				this->buffer_size = new_len;
-				this->line = this->buffer = new_buffer;
-				result = true;
-			}
-		}
-		else
-		{
-			if (new_len < this->max_line_length)
-			{
+	/* the user imposed limit holds whatever room the buffer has */
+	if (this->max_line_length && len >= this->max_line_length)
+	{
+		tinyrl_ding(this);
+		return false;
+	}
+	if (len <= this->buffer_size)
+		return true;
 
-				/* Just reallocate once to the max size */
-				new_buffer = realloc(this->buffer, this->max_line_length);
+	/* 
+	 * What we do depends on whether we are limited by
+	 * memory or a user imposed limit.
+	 */
+	if (this->max_line_length == 0)
+	{
+		/* double the size, a long line is then only copied a few times */
+		new_size = this->buffer_size * 2;
+		if (new_size < len)
+			new_size = len;
+		/* leave space for terminator */
+		new_size++;
+	}
+	else
+	{
+		/* Just reallocate once to the max size */
+		new_size = this->max_line_length;
+	}
 
-				if (NULL == new_buffer)
-				{
-					tinyrl_ding(this);
-					result = false;
-				}
-				else
-				{
-					this->buffer_size = this->max_line_length - 1;
-					this->line = this->buffer = new_buffer;
-					result = true;
-				}
-			}
-			else
-			{
-				tinyrl_ding(this);
-				result = false;
-			}
-		}
+	if (this->buffer == this->inline_buffer)
+	{
+		/* the line outgrows the storage inside the instance */
+		new_buffer = malloc(new_size);
+		if (new_buffer)
+			memcpy(new_buffer, this->buffer, this->buffer_size + 1);
 	}
-	return result;
+	else
+	{
+		new_buffer = realloc(this->buffer, new_size);
+	}
+	if (NULL == new_buffer)
+	{
+		tinyrl_ding(this);
+		return false;
+	}
+	/* the text after the gap stays at the end of the buffer */
+	memmove(&new_buffer[new_size - 1 - tail], &new_buffer[this->buffer_size - tail], tail);
+	if (this->line == this->buffer)
+		this->line = new_buffer;
+	this->buffer = new_buffer;
+	this->buffer_size = new_size - 1;
+	return true;
 }
 
 /*----------------------------------------------------------------------- */
@@ -896,32 +1464,21 @@ bool tinyrl_insert_text_len(tinyrl_t * this, const char *text, unsigned delta)
 	 * If the client wants to change the line ensure that the line and buffer
 	 * references are in sync
 	 */
-	changed_line(this);
-
-	if ((delta + this->end) > (this->buffer_size))
-	{
-		/* extend the current buffer */
-		if (!tinyrl_extend_line_buffer(this, this->end + delta))
-		{
-			return false;
-		}
-	}
+	if (!changed_line(this))
+		return false;
 
-	if (this->point < this->end)
-	{
-		/* move the current text to the right (including the terminator) */
-		memmove(&this->buffer[this->point + delta], &this->buffer[this->point], (this->end - this->point) + 1);
-	}
-	else
+	/* extend the current buffer, also where the line limit is checked */
+	if (!tinyrl_extend_line_buffer(this, this->end + delta))
 	{
-		/* terminate the string */
-		this->buffer[this->end + delta] = '\0';
+		return false;
 	}
 
-	/* insert the new text */
-	strncpy(&this->buffer[this->point], text, delta);
+	/* insert the new text into the gap */
+	tinyrl_gap_move(this, this->point);
+	memcpy(&this->buffer[this->gap], text, delta);
 
 	/* now update the indexes */
+	this->gap += delta;
 	this->point += delta;
 	this->end += delta;
 
@@ -945,11 +1502,12 @@ void tinyrl_delete_text(tinyrl_t * this, unsigned start, unsigned end)
 	if (end == start)
 		return;
 
-	changed_line(this);
+	if (!changed_line(this))
+		return;
 
-	/* move any text which is left, including terminator */
+	/* the deleted text is at the start of the end part, drop it */
 	delta = end - start;
-	memmove(&this->buffer[start], &this->buffer[start + delta], this->end + 1 - end);
+	tinyrl_gap_move(this, start);
 	this->end -= delta;
 
 	/* now adjust the indexs */
@@ -1019,11 +1577,11 @@ void tinyrl_crlf(const tinyrl_t * this)
 {
 	if (this->isatty == 1)
 	{
-		tinyrl_printf(this, "\n");
+		tinyrl_write(this, "\n", 1);
 	}
 	else
 	{
-		tinyrl_printf(this, "\n\r");
+		tinyrl_write(this, "\n\r", 2);
 //		write(fileno(this->ostream), "\r\n", 2);
 	}
 }
@@ -1036,7 +1594,7 @@ void tinyrl_ding(const tinyrl_t * this)
 {
 	if (this->isatty == 1)
 	{
-		tinyrl_printf(this, "\x7");
+		tinyrl_write(this, "\x7", 1);
 		fflush(this->ostream);
 	}
 }
@@ -1045,8 +1603,7 @@ void tinyrl_ding(const tinyrl_t * this)
 void tinyrl_reset_line_state(tinyrl_t * this)
 {
 	/* start from scratch */
-	free(this->last_buffer);
-	this->last_buffer = NULL;
+	this->last_frame = NULL;
 
 	tinyrl_redisplay(this);
 }
@@ -1054,8 +1611,12 @@ void tinyrl_reset_line_state(tinyrl_t * this)
 /*-------------------------------------------------------- */
 void tinyrl_set_line(tinyrl_t * this, const char *text)
 {
+	/* the buffer is kept as a string while another line is shown */
+	tinyrl_line(this);
 	this->line = text ? : this->buffer;
 	this->point = this->end = strlen(this->line);
+	if (this->line == this->buffer)
+		this->gap = this->end;
 }
 
 /*-------------------------------------------------------- */
@@ -1071,6 +1632,8 @@ void tinyrl_replace_line(tinyrl_t * this, const char *text, int clear_undo)
 
 		/* overwrite the current contents of the buffer */
 		strcpy(this->buffer, text);
+		this->line = this->buffer;
+		this->gap = new_len;
 
 		/* set the insert point and end point */
 		this->point = this->end = new_len;
@@ -1081,7 +1644,8 @@ void tinyrl_replace_line(tinyrl_t * this, const char *text, int clear_undo)
 /*--------------------------------------------------------- */
 const char *tinyrl__get_line(const tinyrl_t * this)
 {
-	return this->line;
+	/* closing the gap does not change the line */
+	return tinyrl_line((tinyrl_t *) this);
 }
 
 /*--------------------------------------------------------- */
@@ -1099,8 +1663,23 @@ unsigned tinyrl__get_end(const tinyrl_t * this)
 /*--------------------------------------------------------- */
 unsigned tinyrl__get_width(const tinyrl_t * this)
 {
-	/* hard code until we suss out how to do it properly */
-	return 64;
+	struct winsize ws;
+
+	if (this->width)
+		return this->width;
+	if (this->isatty && 0 == ioctl(fileno(this->ostream), TIOCGWINSZ, &ws) && ws.ws_col)
+		return ws.ws_col;
+	/* the terminal does not tell, assume the usual size */
+	return 80;
+}
+
+/*-------------------------------------------------------- */
+void tinyrl__set_width(tinyrl_t * this, unsigned width)
+{
+	/* the width comes from the peer, a few columns are not a terminal */
+	if (width && width < TINYRL_MIN_WIDTH)
+		width = TINYRL_MIN_WIDTH;
+	this->width = width;
 }
 
 /*--------------------------------------------------------- */
@@ -1129,6 +1708,13 @@ void tinyrl__set_istream(tinyrl_t * this, FILE * istream)
 	this->isatty = isatty(fileno(istream));
 }
 
+/*--------------------------------------------------------- */
+void tinyrl__set_output(tinyrl_t * this, tinyrl_write_func_t *func, void *context)
+{
+	this->write_func = func;
+	this->write_context = context;
+}
+
 /*-------------------------------------------------------- */
 bool tinyrl__get_isatty(const tinyrl_t * this)
 {
@@ -1153,6 +1739,20 @@ const char *tinyrl__get_prompt(const tinyrl_t * this)
 	return this->prompt;
 }
 
+/*-------------------------------------------------------- */
+void tinyrl__set_prompt(tinyrl_t * this, const char *prompt)
+{
+	this->prompt = prompt;
+	this->prompt_len = strlen(prompt);
+}
+
+/*-------------------------------------------------------- */
+void tinyrl__set_key_filter(tinyrl_t * this, tinyrl_key_func_t *filter, void *context)
+{
+	this->key_filter = filter;
+	this->key_filter_context = context;
+}
+
 /*--------------------------------------------------------- */
 void tinyrl_limit_line_length(tinyrl_t * this, unsigned length)
 {
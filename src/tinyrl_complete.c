@@ -5,40 +5,113 @@
 #include <string.h>
 #include <stdlib.h>
 
+/* block of the arena of a set of matches */
+struct tinyrl_matches_block {
+	struct tinyrl_matches_block *next;
+	size_t size;
+	char text[];
+};
+
 /*-------------------------------------------------------- */
-char **tinyrl_add_match(
-	const tinyrl_t *this, unsigned start, char **matches, const char *match)
+void tinyrl_matches_init(
+	struct tinyrl_matches *matches, const tinyrl_t *this, unsigned start)
 {
-	const char *line;
-	unsigned end;
-	size_t len;
-	char **m;
+	memset(matches, 0, sizeof(*matches));
+	matches->word = tinyrl__get_line(this) + start;
+	matches->word_len = tinyrl__get_point(this) - start;
+}
 
-	line = tinyrl__get_line(this);
-	end = tinyrl__get_point(this);
-	if (strncmp(match, line + start, end - start) != 0)
-		return matches;
-
-	len = 0;
-	if (matches)
-		for (m = matches; *m; m++)
-			len++;
-
-	/* Allocate memory for new match, plus terminator */
-	matches = realloc(matches, (len + 2) * sizeof(*matches));
-	matches[len] = strdup(match);
-	matches[len+1] = NULL;
-	return matches;
+/*-------------------------------------------------------- */
+static bool tinyrl_matches_push(
+	struct tinyrl_matches *matches, char *match, size_t len)
+{
+	unsigned common;
+
+	if (matches->count + 1 >= matches->size) {
+		unsigned size = matches->size ? matches->size * 2 : 16;
+		char **grown = realloc(matches->match, size * sizeof(*grown));
+
+		if (!grown)
+			return false;
+		matches->match = grown;
+		matches->size = size;
+	}
+
+	/* the shared prefix can only get shorter, and the matches all
+	   start with the word */
+	if (!matches->count) {
+		matches->common = len;
+		matches->complete = true;
+	} else {
+		const char *first = matches->match[0];
+
+		for (common = matches->word_len; common < matches->common; common++)
+			if (first[common] != match[common])
+				break;
+		if (common < matches->common) {
+			matches->common = common;
+			matches->complete = len == common;
+		} else if (len == common) {
+			matches->complete = true;
+		}
+	}
+
+	matches->match[matches->count++] = match;
+	matches->match[matches->count] = NULL;
+	return true;
+}
+
+/*-------------------------------------------------------- */
+bool tinyrl_matches_add(struct tinyrl_matches *matches, const char *match)
+{
+	if (strncmp(match, matches->word, matches->word_len) != 0)
+		return true;
+	return tinyrl_matches_push(matches, (char *) match, strlen(match));
+}
+
+/*-------------------------------------------------------- */
+bool tinyrl_matches_add_copy(
+	struct tinyrl_matches *matches, const char *match, size_t len)
+{
+	struct tinyrl_matches_block *block = matches->arena;
+	char *copy;
+
+	if (len < matches->word_len
+	    || memcmp(match, matches->word, matches->word_len) != 0)
+		return true;
+
+	if (!block || block->size - matches->arena_used < len + 1) {
+		size_t size = len + 1 > TINYRL_MATCHES_BLOCK ?
+			len + 1 : TINYRL_MATCHES_BLOCK;
+
+		block = malloc(sizeof(*block) + size);
+		if (!block)
+			return false;
+		block->next = matches->arena;
+		block->size = size;
+		matches->arena = block;
+		matches->arena_used = 0;
+	}
+	copy = block->text + matches->arena_used;
+	memcpy(copy, match, len);
+	copy[len] = '\0';
+	matches->arena_used += len + 1;
+	return tinyrl_matches_push(matches, copy, len);
 }
 
 /*-------------------------------------------------------- */
-void tinyrl_delete_matches(char **matches)
+void tinyrl_matches_release(struct tinyrl_matches *matches)
 {
-	char **m;
+	struct tinyrl_matches_block *block, *next;
 
-	for (m = matches; *m; m++)
-		free(*m);
-	free(matches);
+	for (block = matches->arena; block; block = next) {
+		next = block->next;
+		free(block);
+	}
+	free(matches->match);
+	matches->arena = NULL;
+	matches->match = NULL;
+	matches->count = matches->size = 0;
 }
 
 /*----------------------------------------------------------------------- */
@@ -63,12 +136,14 @@ void tinyrl_display_matches(const tinyrl_t * this, char *const *matches)
 
 	/* allow for a space between words */
 	cols = tinyrl__get_width(this) / (max + 1);
+	/* a match wider than the terminal still takes a line of its own */
+	if (!cols)
+		cols = 1;
 	tinyrl_crlf(this);
 	/* print out a table of completions */
-	m = matches;
 	for (m = matches; *m; ) {
 		for (c = 0; c < cols && *m; c++, m++){
-				tinyrl_printf(this, "%-*s ", max, *m);
+				tinyrl_printf(this, "%-*s ", (int) max, *m);
 		}
 
 		tinyrl_crlf(this);
@@ -78,38 +153,74 @@ void tinyrl_display_matches(const tinyrl_t * this, char *const *matches)
 
 /*-------------------------------------------------------- */
 bool tinyrl_complete(
-	tinyrl_t *this, unsigned start, char **matches, bool allow_prefix)
+	tinyrl_t *this, unsigned start, const struct tinyrl_matches *matches,
+	bool allow_prefix)
 {
-	const char *line;
-	unsigned end, len;
+	unsigned end;
 	bool completion;
-	bool prefix;
-	int i;
 
-	if (!matches || !matches[0])
+	if (!matches->count)
 		return false;
 
-	/* identify common prefix */
-	len = strlen(matches[0]);
-	prefix = true;
-	for (i = 1; matches[i]; i++) {
-		unsigned common;
-		for (common = 0; common < len; common++)
-			if (matches[0][common] != matches[i][common])
-				break;
-		if (len != common) {
-			len = common;
-			prefix = !matches[i][len];
-		}
+	/* insert common prefix, the matches all start with the word */
+	end = tinyrl__get_point(this);
+	if (matches->common > end - start) {
+		tinyrl_delete_text(this, start, end);
+		if (!tinyrl_insert_text_len(this, matches->match[0],
+					    matches->common))
+			return false;
+		tinyrl_redisplay(this);
+		completion = true;
+	} else {
+		completion = false;
 	}
 
-	/* insert common prefix */
+	/* is there only one completion? */
+	if (matches->count == 1)
+		return true;
+
+	/* is the prefix valid? */
+	if (matches->complete && allow_prefix)
+		return true;
+
+	/* display matches if no progress was made */
+	if (!completion) {
+		tinyrl_crlf(this);
+		tinyrl_display_matches(this, matches->match);
+		tinyrl_reset_line_state(this);
+	}
+
+	return false;
+}
+
+/*-------------------------------------------------------- */
+static bool tinyrl_radix_collect(void *context, const char *word, void *value)
+{
+	/* the words stay in the tree */
+	return tinyrl_matches_add(context, word);
+}
+
+/*-------------------------------------------------------- */
+bool tinyrl_complete_radix(
+	tinyrl_t *this, unsigned start, const struct tinyrl_radix *radix,
+	bool allow_prefix)
+{
+	struct tinyrl_radix_range range;
+	struct tinyrl_matches matches;
+	const char *line;
+	unsigned end;
+	bool completion;
+
 	line = tinyrl__get_line(this);
 	end = tinyrl__get_point(this);
-	if (end - start < len
-	    || strncmp(line + start, matches[0], len) != 0) {
+	tinyrl_radix_prefix(radix, line + start, end - start, &range);
+	if (!range.count)
+		return false;
+
+	/* insert common prefix */
+	if (range.common > end - start) {
 		tinyrl_delete_text(this, start, end);
-		if (!tinyrl_insert_text_len(this, matches[0], len))
+		if (!tinyrl_insert_text_len(this, range.word, range.common))
 			return false;
 		tinyrl_redisplay(this);
 		completion = true;
@@ -118,19 +229,75 @@ bool tinyrl_complete(
 	}
 
 	/* is there only one completion? */
-	if (!matches[1])
+	if (range.count == 1)
 		return true;
 
 	/* is the prefix valid? */
-	if (prefix && allow_prefix)
+	if (range.complete && allow_prefix)
 		return true;
 
 	/* display matches if no progress was made */
 	if (!completion) {
+		tinyrl_matches_init(&matches, this, start);
+		tinyrl_radix_walk(radix, line + start, end - start,
+				  tinyrl_radix_collect, &matches);
+		if (matches.count) {
+			tinyrl_crlf(this);
+			tinyrl_display_matches(this, matches.match);
+			tinyrl_reset_line_state(this);
+		}
+		tinyrl_matches_release(&matches);
+	}
+
+	return false;
+}
+
+/*-------------------------------------------------------- */
+bool tinyrl_complete_fuzzy(
+	tinyrl_t *this, unsigned start, const struct tinyrl_fuzzy *fuzzy,
+	unsigned k)
+{
+	const char **best;
+	const char *line;
+	unsigned end, count;
+	bool completion = false;
+
+	best = malloc((k + 1) * sizeof(*best));
+	if (!best)
+		return false;
+	line = tinyrl__get_line(this);
+	end = tinyrl__get_point(this);
+	count = tinyrl_fuzzy_rank(fuzzy, line + start, end - start, best, k);
+
+	if (count == 1) {
+		tinyrl_delete_text(this, start, end);
+		completion = tinyrl_insert_text(this, best[0]);
+		tinyrl_redisplay(this);
+	} else if (count) {
+		/* ranked, not sorted */
+		best[count] = NULL;
 		tinyrl_crlf(this);
-		tinyrl_display_matches(this, matches);
+		tinyrl_display_matches(this, (char *const *) best);
 		tinyrl_reset_line_state(this);
 	}
 
-	return false;
+	free(best);
+	return completion;
+}
+
+/*-------------------------------------------------------- */
+bool tinyrl_complete_provider(
+	tinyrl_t *this, unsigned start, struct tinyrl_provider *provider,
+	bool allow_prefix)
+{
+	struct tinyrl_provider_values *values;
+	bool completion;
+
+	/* never waits, a fetch of values expired goes on in the background */
+	values = tinyrl_provider_get(provider);
+	if (!values)
+		return false;
+	completion = tinyrl_complete_radix(this, start, values->radix, allow_prefix);
+	tinyrl_provider_release(values);
+	return completion;
 }
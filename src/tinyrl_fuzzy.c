@@ -0,0 +1,523 @@
+/*
+ * fuzzy.c
+ *
+ * Ranking of words matching a fragment as a subsequence
+ */
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "tinyrl_fuzzy.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define FUZZY_X86
+#endif
+
+/* bytes of the slot holding the start of each word */
+#define FUZZY_SLOT 32
+
+/* words left by the bitmaps whose slots are fetched before matching any */
+#define FUZZY_BATCH 64
+
+/* score of a character matched, plus when it follows the previous one or
+   starts a word part, minus one per character skipped up to FUZZY_GAP */
+#define FUZZY_MATCH 16
+#define FUZZY_CONSECUTIVE 16
+#define FUZZY_BOUNDARY 8
+#define FUZZY_GAP 15
+
+struct fuzzy_query {
+	char *text;		/* lowercased */
+	size_t len;
+	uint32_t bag;		/* characters it holds */
+};
+
+struct fuzzy_hit {
+	int score;
+	unsigned index;
+};
+
+/* the best hits so far, in a heap whose top is the worst of them */
+struct fuzzy_top {
+	const struct tinyrl_fuzzy *fuzzy;
+	struct fuzzy_hit *hit;
+	unsigned len;
+	unsigned k;
+};
+
+typedef void fuzzy_scan_t(const struct tinyrl_fuzzy *fuzzy,
+			  const struct fuzzy_query *query, struct fuzzy_top *top);
+
+/*
+ * The words are kept in arrays rather than one struct per word, so the
+ * bitmaps are scanned without touching anything else.
+ */
+struct tinyrl_fuzzy {
+	unsigned count;
+	unsigned size;		/* words the arrays have room for */
+	uint32_t *bag;		/* characters held by each word */
+	uint32_t *boundary;	/* places of its slot starting a word part */
+	unsigned *len;
+	const char **word;
+	char (*slot)[FUZZY_SLOT];	/* words lowercased, zero padded */
+	fuzzy_scan_t *scan;
+};
+
+/*------------------------------------- */
+static unsigned char fuzzy_lower(unsigned char c)
+{
+	return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+/*------------------------------------- */
+/* c lowercased. The digits share five bits, the other characters one. */
+static uint32_t fuzzy_bag(unsigned char c)
+{
+	if (c >= 'a' && c <= 'z')
+		return 1u << (c - 'a');
+	if (c >= '0' && c <= '9')
+		return 1u << (26 + (c - '0') % 5);
+	return 1u << 31;
+}
+
+/*------------------------------------- */
+/* c lowercased. Bytes of multibyte characters are part of a word. */
+static bool fuzzy_separator(unsigned char c)
+{
+	return c < 0x80 && !(c >= 'a' && c <= 'z') && !(c >= '0' && c <= '9');
+}
+
+/*------------------------------------- */
+static int fuzzy_step(int prev, int pos, bool boundary)
+{
+	int gap = pos - prev - 1;
+	int score = FUZZY_MATCH;
+
+	if (prev >= 0 && !gap)
+		score += FUZZY_CONSECUTIVE;
+	if (boundary)
+		score += FUZZY_BOUNDARY;
+	return score - (gap < FUZZY_GAP ? gap : FUZZY_GAP);
+}
+
+/*------------------------------------- */
+/* match each character of the query at the first place it is found */
+static int fuzzy_score_text(const char *word, const struct fuzzy_query *query)
+{
+	const unsigned char *text = (const unsigned char *) word;
+	int prev = -1, pos = 0, score = 0;
+	size_t i;
+
+	for (i = 0; i < query->len; i++) {
+		while (text[pos] && fuzzy_lower(text[pos]) != (unsigned char) query->text[i])
+			pos++;
+		if (!text[pos])
+			return -1;
+		score += fuzzy_step(prev, pos,
+				    !pos || fuzzy_separator(fuzzy_lower(text[pos - 1])));
+		prev = pos++;
+	}
+	return score;
+}
+
+/*------------------------------------- */
+/*
+ * The same match, with the places of each character of the query in a slot
+ * given by the bits of eq. The boundary bonus is left out, the places
+ * matched are returned in matched to add it.
+ */
+static inline int fuzzy_score_bits(const uint32_t *eq, size_t len,
+				   uint32_t *matched)
+{
+	int prev = -1, score = 0;
+	size_t i;
+
+	*matched = 0;
+	for (i = 0; i < len; i++) {
+		uint32_t after = eq[i] & (uint32_t) (~(uint64_t) 0 << (prev + 1));
+		int pos;
+
+		if (!after)
+			return -1;
+		pos = __builtin_ctz(after);
+		score += fuzzy_step(prev, pos, false);
+		*matched |= 1u << pos;
+		prev = pos;
+	}
+	return score;
+}
+
+/*------------------------------------- */
+static bool fuzzy_better(const struct tinyrl_fuzzy *fuzzy,
+			 const struct fuzzy_hit *a, const struct fuzzy_hit *b)
+{
+	if (a->score != b->score)
+		return a->score > b->score;
+	if (fuzzy->len[a->index] != fuzzy->len[b->index])
+		return fuzzy->len[a->index] < fuzzy->len[b->index];
+	return a->index < b->index;
+}
+
+/*------------------------------------- */
+/* put hit at i in the heap of the len first hits, moving it down */
+static void fuzzy_sift_down(struct fuzzy_top *top, unsigned i, unsigned len,
+			    struct fuzzy_hit hit)
+{
+	unsigned child;
+
+	for (; (child = 2 * i + 1) < len; i = child) {
+		if (child + 1 < len
+		    && fuzzy_better(top->fuzzy, &top->hit[child], &top->hit[child + 1]))
+			child++;
+		if (!fuzzy_better(top->fuzzy, &hit, &top->hit[child]))
+			break;
+		top->hit[i] = top->hit[child];
+	}
+	top->hit[i] = hit;
+}
+
+/*------------------------------------- */
+static void fuzzy_top_put(struct fuzzy_top *top, struct fuzzy_hit hit)
+{
+	unsigned i;
+
+	if (top->len == top->k) {
+		/* in place of the worst */
+		fuzzy_sift_down(top, 0, top->len, hit);
+		return;
+	}
+	for (i = top->len++; i; i = (i - 1) / 2) {
+		if (!fuzzy_better(top->fuzzy, &top->hit[(i - 1) / 2], &hit))
+			break;
+		top->hit[i] = top->hit[(i - 1) / 2];
+	}
+	top->hit[i] = hit;
+}
+
+/*------------------------------------- */
+/*
+ * Keep the word at index if it is among the best so far. The words are
+ * added in the order of the set, so one as good as the worst kept only
+ * gets in by being shorter.
+ */
+static inline void fuzzy_top_add(struct fuzzy_top *top, int score,
+				 unsigned index)
+{
+	const struct fuzzy_hit *worst = &top->hit[0];
+	struct fuzzy_hit hit = { score, index };
+
+	if (score < 0)
+		return;
+	if (top->len < top->k || score > worst->score
+	    || (score == worst->score
+		&& top->fuzzy->len[index] < top->fuzzy->len[worst->index]))
+		fuzzy_top_put(top, hit);
+}
+
+/*------------------------------------- */
+static void fuzzy_scan_scalar(const struct tinyrl_fuzzy *fuzzy,
+			      const struct fuzzy_query *query, struct fuzzy_top *top)
+{
+	unsigned i;
+
+	for (i = 0; i < fuzzy->count; i++) {
+		if ((fuzzy->bag[i] & query->bag) != query->bag
+		    || fuzzy->len[i] < query->len)
+			continue;
+		fuzzy_top_add(top, fuzzy_score_text(fuzzy->word[i], query), i);
+	}
+}
+
+#if defined(FUZZY_X86)
+/*------------------------------------- */
+static inline int fuzzy_slot_sse2(const struct tinyrl_fuzzy *fuzzy,
+				  unsigned i, const struct fuzzy_query *query)
+{
+	const __m128i *slot = (const __m128i *) fuzzy->slot[i];
+	__m128i low = _mm_load_si128(slot), high = _mm_load_si128(slot + 1);
+	uint32_t eq[FUZZY_SLOT], matched;
+	size_t j;
+	int score;
+
+	if (fuzzy->len[i] > FUZZY_SLOT)
+		return fuzzy_score_text(fuzzy->word[i], query);
+	for (j = 0; j < query->len; j++) {
+		__m128i c = _mm_set1_epi8(query->text[j]);
+
+		eq[j] = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(low, c))
+			| (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(high, c)) << 16;
+	}
+
+	score = fuzzy_score_bits(eq, query->len, &matched);
+	return score < 0 ? -1 :
+		score + FUZZY_BOUNDARY * __builtin_popcount(matched & fuzzy->boundary[i]);
+}
+
+/*------------------------------------- */
+static void fuzzy_scan_sse2(const struct tinyrl_fuzzy *fuzzy,
+			    const struct fuzzy_query *query, struct fuzzy_top *top)
+{
+	__m128i bag = _mm_set1_epi32((int) query->bag);
+	unsigned batch[FUZZY_BATCH + 4];
+	unsigned i, j, n = 0, hits;
+
+	for (i = 0; i < fuzzy->count; i += 4) {
+		if (i + 4 <= fuzzy->count) {
+			__m128i held = _mm_loadu_si128((const __m128i *) (fuzzy->bag + i));
+
+			hits = _mm_movemask_ps(_mm_castsi128_ps(
+				_mm_cmpeq_epi32(_mm_and_si128(held, bag), bag)));
+		} else {
+			for (hits = 0, j = i; j < fuzzy->count; j++)
+				if ((fuzzy->bag[j] & query->bag) == query->bag)
+					hits |= 1u << (j - i);
+		}
+		for (; hits; hits &= hits - 1) {
+			j = i + __builtin_ctz(hits);
+			if (fuzzy->len[j] < query->len)
+				continue;
+			__builtin_prefetch(fuzzy->slot[j]);
+			batch[n++] = j;
+		}
+		if (n < FUZZY_BATCH && i + 4 < fuzzy->count)
+			continue;
+		for (j = 0; j < n; j++)
+			fuzzy_top_add(top, fuzzy_slot_sse2(fuzzy, batch[j], query), batch[j]);
+		n = 0;
+	}
+}
+
+/*------------------------------------- */
+__attribute__ ((target("avx2,popcnt")))
+static inline int fuzzy_slot_avx2(const struct tinyrl_fuzzy *fuzzy,
+				  unsigned i, const struct fuzzy_query *query)
+{
+	__m256i v = _mm256_load_si256((const __m256i *) fuzzy->slot[i]);
+	uint32_t eq[FUZZY_SLOT], matched;
+	size_t j;
+	int score;
+
+	if (fuzzy->len[i] > FUZZY_SLOT)
+		return fuzzy_score_text(fuzzy->word[i], query);
+	for (j = 0; j < query->len; j++)
+		eq[j] = (uint32_t) _mm256_movemask_epi8(
+			_mm256_cmpeq_epi8(v, _mm256_set1_epi8(query->text[j])));
+
+	score = fuzzy_score_bits(eq, query->len, &matched);
+	return score < 0 ? -1 :
+		score + FUZZY_BOUNDARY * __builtin_popcount(matched & fuzzy->boundary[i]);
+}
+
+/*------------------------------------- */
+__attribute__ ((target("avx2,popcnt")))
+static void fuzzy_scan_avx2(const struct tinyrl_fuzzy *fuzzy,
+			    const struct fuzzy_query *query, struct fuzzy_top *top)
+{
+	__m256i bag = _mm256_set1_epi32((int) query->bag);
+	unsigned batch[FUZZY_BATCH + 8];
+	unsigned i, j, n = 0, hits;
+
+	for (i = 0; i < fuzzy->count; i += 8) {
+		if (i + 8 <= fuzzy->count) {
+			__m256i held = _mm256_loadu_si256((const __m256i *) (fuzzy->bag + i));
+
+			hits = _mm256_movemask_ps(_mm256_castsi256_ps(
+				_mm256_cmpeq_epi32(_mm256_and_si256(held, bag), bag)));
+		} else {
+			for (hits = 0, j = i; j < fuzzy->count; j++)
+				if ((fuzzy->bag[j] & query->bag) == query->bag)
+					hits |= 1u << (j - i);
+		}
+		for (; hits; hits &= hits - 1) {
+			j = i + __builtin_ctz(hits);
+			if (fuzzy->len[j] < query->len)
+				continue;
+			__builtin_prefetch(fuzzy->slot[j]);
+			batch[n++] = j;
+		}
+		if (n < FUZZY_BATCH && i + 8 < fuzzy->count)
+			continue;
+		for (j = 0; j < n; j++)
+			fuzzy_top_add(top, fuzzy_slot_avx2(fuzzy, batch[j], query), batch[j]);
+		n = 0;
+	}
+}
+#endif
+
+/*------------------------------------- */
+struct tinyrl_fuzzy *tinyrl_fuzzy_new(void)
+{
+	struct tinyrl_fuzzy *fuzzy = calloc(1, sizeof(*fuzzy));
+
+	if (!fuzzy)
+		return NULL;
+	fuzzy->scan = fuzzy_scan_scalar;
+#if defined(FUZZY_X86)
+	fuzzy->scan = fuzzy_scan_sse2;
+	if (__builtin_cpu_supports("avx2"))
+		fuzzy->scan = fuzzy_scan_avx2;
+#endif
+	return fuzzy;
+}
+
+/*------------------------------------- */
+void tinyrl_fuzzy_delete(struct tinyrl_fuzzy *fuzzy)
+{
+	if (!fuzzy)
+		return;
+	free(fuzzy->bag);
+	free(fuzzy->boundary);
+	free(fuzzy->len);
+	free(fuzzy->word);
+	free(fuzzy->slot);
+	free(fuzzy);
+}
+
+/*------------------------------------- */
+static bool fuzzy_grow(struct tinyrl_fuzzy *fuzzy)
+{
+	unsigned size = fuzzy->size ? fuzzy->size * 2 : 64;
+	char (*slot)[FUZZY_SLOT];
+	uint32_t *bag, *boundary;
+	unsigned *len;
+	const char **word;
+
+	/* the slots are aligned for the vector loads, realloc would not
+	   keep them so */
+	slot = aligned_alloc(FUZZY_SLOT, (size_t) size * FUZZY_SLOT);
+	if (!slot)
+		return false;
+	if (fuzzy->count)
+		memcpy(slot, fuzzy->slot, (size_t) fuzzy->count * FUZZY_SLOT);
+	free(fuzzy->slot);
+	fuzzy->slot = slot;
+
+	bag = realloc(fuzzy->bag, size * sizeof(*bag));
+	if (!bag)
+		return false;
+	fuzzy->bag = bag;
+	boundary = realloc(fuzzy->boundary, size * sizeof(*boundary));
+	if (!boundary)
+		return false;
+	fuzzy->boundary = boundary;
+	len = realloc(fuzzy->len, size * sizeof(*len));
+	if (!len)
+		return false;
+	fuzzy->len = len;
+	word = realloc(fuzzy->word, size * sizeof(*word));
+	if (!word)
+		return false;
+	fuzzy->word = word;
+
+	fuzzy->size = size;
+	return true;
+}
+
+/*------------------------------------- */
+bool tinyrl_fuzzy_add(struct tinyrl_fuzzy *fuzzy, const char *word)
+{
+	const unsigned char *text = (const unsigned char *) word;
+	char *slot;
+	uint32_t bag = 0, boundary = 1;
+	size_t i;
+
+	if (fuzzy->count == fuzzy->size && !fuzzy_grow(fuzzy))
+		return false;
+
+	slot = fuzzy->slot[fuzzy->count];
+	memset(slot, 0, FUZZY_SLOT);
+	for (i = 0; text[i]; i++) {
+		unsigned char c = fuzzy_lower(text[i]);
+
+		if (i < FUZZY_SLOT) {
+			slot[i] = c;
+			if (i + 1 < FUZZY_SLOT && fuzzy_separator(c))
+				boundary |= 1u << (i + 1);
+		}
+		bag |= fuzzy_bag(c);
+	}
+	fuzzy->bag[fuzzy->count] = bag;
+	fuzzy->boundary[fuzzy->count] = boundary;
+	fuzzy->len[fuzzy->count] = i;
+	fuzzy->word[fuzzy->count] = word;
+	fuzzy->count++;
+	return true;
+}
+
+/*------------------------------------- */
+unsigned tinyrl_fuzzy_count(const struct tinyrl_fuzzy *fuzzy)
+{
+	return fuzzy->count;
+}
+
+/*------------------------------------- */
+static bool fuzzy_query_init(struct fuzzy_query *query, const char *fragment,
+			     size_t len)
+{
+	size_t i;
+
+	query->text = malloc(len + 1);
+	if (!query->text)
+		return false;
+	query->len = len;
+	query->bag = 0;
+	for (i = 0; i < len; i++) {
+		query->text[i] = fuzzy_lower(fragment[i]);
+		query->bag |= fuzzy_bag(query->text[i]);
+	}
+	query->text[len] = '\0';
+	return true;
+}
+
+/*------------------------------------- */
+int tinyrl_fuzzy_score(const char *word, const char *fragment, size_t len)
+{
+	struct fuzzy_query query;
+	int score;
+
+	if (!fuzzy_query_init(&query, fragment, len))
+		return -1;
+	score = fuzzy_score_text(word, &query);
+	free(query.text);
+	return score;
+}
+
+/*------------------------------------- */
+unsigned tinyrl_fuzzy_rank(const struct tinyrl_fuzzy *fuzzy,
+			   const char *fragment, size_t len,
+			   const char **best, unsigned k)
+{
+	struct fuzzy_query query;
+	struct fuzzy_top top;
+	unsigned i;
+
+	if (!k || !fuzzy->count)
+		return 0;
+	if (!fuzzy_query_init(&query, fragment, len))
+		return 0;
+	top.fuzzy = fuzzy;
+	top.k = k < fuzzy->count ? k : fuzzy->count;
+	top.len = 0;
+	top.hit = malloc(top.k * sizeof(*top.hit));
+	if (!top.hit) {
+		free(query.text);
+		return 0;
+	}
+
+	fuzzy->scan(fuzzy, &query, &top);
+
+	/* sort the heap, moving the worst to the end */
+	for (i = top.len; i > 1; i--) {
+		struct fuzzy_hit worst = top.hit[0];
+
+		fuzzy_sift_down(&top, 0, i - 1, top.hit[i - 1]);
+		top.hit[i - 1] = worst;
+	}
+	for (i = 0; i < top.len; i++)
+		best[i] = fuzzy->word[top.hit[i].index];
+
+	free(top.hit);
+	free(query.text);
+	return top.len;
+}
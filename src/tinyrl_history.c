@@ -8,26 +8,256 @@
 #include <assert.h>
 
 #include <stdlib.h>
+#include <stdint.h>
 #include "tinyrl_history.h"
+#include "tinyrl_history_file.h"
 
 
 
+/*
+ * The entries are kept in a single slab as null terminated strings, one
+ * after the other, and used as a ring: new entries are written at head and
+ * the oldest entry is dropped by moving tail past it. An entry is never
+ * split, if it does not fit before the end of the slab it goes to the start.
+ * The offsets of the entries in the slab are a ring as well, so adding to a
+ * full history moves nothing.
+ *
+ * The entries loaded from a history file come first. They stay in the file
+ * mapping, the oldest of them are dropped by moving mapped_first.
+ */
+
+/* longest query of a reverse search */
+#define HISTORY_QUERY_SIZE 64
+
+/* state of the reverse search typed with ctrl-R */
+struct tinyrl_history_search {
+	char query[HISTORY_QUERY_SIZE];
+	unsigned query_len;
+	bool failed;		/* no entry holds the query */
+	unsigned match;		/* position of the entry shown */
+	const char *line;	/* line shown when the search started */
+	const char *prompt;	/* prompt of that line */
+	char text[HISTORY_QUERY_SIZE + 32];	/* prompt shown by the search */
+};
+
+/*
+ * Entries holding each trigram, by sequence number: the position of an
+ * entry plus the number of entries dropped before it (base). Trigrams are
+ * hashed to a bucket, so an entry found still has to be checked.
+ */
+struct tinyrl_history_postings {
+	uint32_t *seq;		/* in ascending order */
+	unsigned start;		/* first one which may still be in use */
+	unsigned len;
+	unsigned size;
+};
+
+/*
+ * Entries shared by several histories. An entry is written in place in
+ * the slot of a ring reserved by an atomic increment of head. The stamp of
+ * the slot tells its state: 2 * seq + 1 while entry seq is written, then
+ * 2 * seq + 2. A reader copies the text and checks the stamp again, as with
+ * a seqlock.
+ */
+#define HISTORY_SHARED_LINE 248
+
+struct tinyrl_history_slot {
+	uint64_t stamp;
+	char text[HISTORY_SHARED_LINE];
+};
+
+struct tinyrl_history_shared {
+	uint64_t head;		/* sequence number of the next entry */
+	unsigned size;		/* number of slots */
+	struct tinyrl_history_slot slot[];
+};
+
 struct tinyrl_history {
 	tinyrl_t *tinyrl;
-	char **entries;	/* pointer entries */
-	unsigned length;	/* Number of elements within this array */
-	unsigned size;		/* Number of slots allocated in this array */
+	struct tinyrl_history_shared *shared;	/* where new entries go, NULL
+				   if the history is its own */
+	uint64_t shared_next;	/* next entry of shared to be copied */
+	struct tinyrl_history_file *file;	/* where new entries are written */
+	struct tinyrl_history_map *map;	/* entries loaded from the file */
+	const uint64_t *mapped;	/* offsets of the loaded entries in map */
+	uint64_t *mapped_copy;	/* mapped, once an entry has been removed */
+	unsigned mapped_first;	/* first loaded entry still in use */
+	unsigned mapped_length;	/* loaded entries in use */
+	char *slab;		/* text of the entries */
+	size_t slab_size;	/* bytes allocated for slab */
+	size_t head;		/* where the next entry goes in slab */
+	size_t tail;		/* offset of the oldest entry in slab */
+	size_t *offsets;	/* offset of each entry in slab, oldest at first */
+	unsigned slots;		/* number of offsets allocated */
+	unsigned first;		/* slot of the oldest entry */
+	unsigned length;	/* Number of entries in the slab */
 	unsigned limit;
 	unsigned iter;
+	uint32_t base;		/* sequence number of the oldest entry */
+	struct tinyrl_history_postings *index;	/* trigram index, built by
+				   the first search which needs it */
+	struct tinyrl_history_search search;
 };
 
+/* initial sizes of a history, both are doubled as needed */
+#define HISTORY_SLAB_SIZE 1024
+#define HISTORY_SLOTS 16
+
+/* the index has 2^HISTORY_INDEX_BITS buckets */
+#define HISTORY_INDEX_BITS 16
+/* a smaller history is simply scanned */
+#define HISTORY_INDEX_MIN 256
+
+static void history_add(struct tinyrl_history *history, const char *line);
+static void history_shared_sync(struct tinyrl_history *history);
+
+/*
+   TRIGRAM INDEX
+   */
+/*------------------------------------- */
+static unsigned trigram_bucket(const char *text)
+{
+	uint32_t trigram = (unsigned char) text[0] << 16
+	    | (unsigned char) text[1] << 8 | (unsigned char) text[2];
+
+	return (trigram * 2654435761u) >> (32 - HISTORY_INDEX_BITS);
+}
+
+/*------------------------------------- */
+static void history_index_drop(struct tinyrl_history *history)
+{
+	unsigned i;
+
+	if (!history->index)
+		return;
+	for (i = 0; i < (1u << HISTORY_INDEX_BITS); i++)
+		free(history->index[i].seq);
+	free(history->index);
+	history->index = NULL;
+}
+
+/*------------------------------------- */
+/* add the trigrams of the entry with sequence number seq */
+static bool history_index_add(struct tinyrl_history *history, uint32_t seq,
+			      const char *line)
+{
+	for (; line[0] && line[1] && line[2]; line++) {
+		struct tinyrl_history_postings *postings =
+		    &history->index[trigram_bucket(line)];
+
+		if (postings->len > postings->start
+		    && postings->seq[postings->len - 1] == seq)
+			continue;
+
+		/* forget the entries dropped since the bucket was last used */
+		while (postings->start < postings->len
+		       && postings->seq[postings->start] < history->base)
+			postings->start++;
+		if (postings->start && postings->start >= postings->len / 2) {
+			postings->len -= postings->start;
+			memmove(postings->seq, postings->seq + postings->start,
+				sizeof(*postings->seq) * postings->len);
+			postings->start = 0;
+		}
+
+		if (postings->len == postings->size) {
+			unsigned size = postings->size ? postings->size * 2 : 4;
+			uint32_t *seqs = realloc(postings->seq, sizeof(*seqs) * size);
+
+			if (!seqs)
+				return false;
+			postings->seq = seqs;
+			postings->size = size;
+		}
+		postings->seq[postings->len++] = seq;
+	}
+	return true;
+}
+
+/*------------------------------------- */
+static void history_index_build(struct tinyrl_history *history)
+{
+	unsigned i, length = tinyrl_history_length(history);
+
+	history->index = calloc(1u << HISTORY_INDEX_BITS, sizeof(*history->index));
+	if (!history->index)
+		return;
+	for (i = 0; i < length; i++) {
+		if (!history_index_add(history, history->base + i,
+				       tinyrl_history_get(history, i))) {
+			history_index_drop(history);
+			return;
+		}
+	}
+}
+
+/*------------------------------------- */
+/*
+ * Find the newest entry holding query among the entries before position
+ * before. Only the entries of the bucket of the rarest trigram of the
+ * query are checked.
+ */
+static bool history_find(struct tinyrl_history *history, const char *query,
+			 unsigned before, unsigned *position)
+{
+	size_t len = strlen(query);
+	struct tinyrl_history_postings *best = NULL;
+	unsigned i, low, high;
+
+	if (len >= 3 && !history->index
+	    && tinyrl_history_length(history) >= HISTORY_INDEX_MIN)
+		history_index_build(history);
+
+	if (len < 3 || !history->index) {
+		while (before--) {
+			if (strstr(tinyrl_history_get(history, before), query)) {
+				*position = before;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	for (i = 0; i + 2 < len; i++) {
+		struct tinyrl_history_postings *postings =
+		    &history->index[trigram_bucket(query + i)];
+
+		if (!best || postings->len - postings->start < best->len - best->start)
+			best = postings;
+	}
+
+	/* the candidates before the position, newest first */
+	low = best->start;
+	high = best->len;
+	while (low < high) {
+		unsigned middle = low + (high - low) / 2;
+
+		if (best->seq[middle] < history->base + before)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	while (low-- > best->start && best->seq[low] >= history->base) {
+		unsigned candidate = best->seq[low] - history->base;
+
+		if (strstr(tinyrl_history_get(history, candidate), query)) {
+			*position = candidate;
+			return true;
+		}
+	}
+	return false;
+}
+
 /*-------------------------------------------------------- */
 bool tinyrl_history_key_up(void *context, int key)
 {
 	struct tinyrl_history *history = context;
 
-	if (tinyrl_history_get(history, history->iter) != tinyrl__get_line(history->tinyrl))
+	if (tinyrl_history_get(history, history->iter) != tinyrl__get_line(history->tinyrl)) {
+		/* a new walk through the history, from its latest state */
+		history_shared_sync(history);
 		history->iter = tinyrl_history_length(history);
+	}
 	if (history->iter == 0)
 		return false;
 	history->iter--;
@@ -48,125 +278,418 @@ bool tinyrl_history_key_down(void *context, int key)
 	return true;
 }
 
+/*
+   REVERSE SEARCH
+   */
+/*------------------------------------- */
+static void history_search_show(struct tinyrl_history *history)
+{
+	struct tinyrl_history_search *search = &history->search;
+
+	snprintf(search->text, sizeof(search->text), "(%sreverse-i-search)`%s': ",
+		 search->failed ? "failed " : "", search->query);
+	tinyrl__set_prompt(history->tinyrl, search->text);
+}
+
+/*------------------------------------- */
+/* show the newest entry holding the query before position before */
+static void history_search_find(struct tinyrl_history *history, unsigned before)
+{
+	struct tinyrl_history_search *search = &history->search;
+	unsigned position;
+
+	search->failed = !history_find(history, search->query, before, &position);
+	if (search->failed) {
+		tinyrl_ding(history->tinyrl);
+		return;
+	}
+	search->match = position;
+	tinyrl_set_line(history->tinyrl, tinyrl_history_get(history, position));
+}
+
+/*------------------------------------- */
+static void history_search_end(struct tinyrl_history *history)
+{
+	tinyrl__set_key_filter(history->tinyrl, NULL, NULL);
+	tinyrl__set_prompt(history->tinyrl, history->search.prompt);
+}
+
+/*------------------------------------- */
+/*
+ * Key filter while searching: the keys typed make the query, ctrl-R looks
+ * for an older entry and ctrl-G goes back to the line the search started
+ * from. Any other key keeps the entry found and is then handled as usual.
+ */
+static bool history_search_key(void *context, int key)
+{
+	struct tinyrl_history *history = context;
+	struct tinyrl_history_search *search = &history->search;
+	unsigned length = tinyrl_history_length(history);
+
+	switch (key) {
+	case CTRL('R'):
+		if (search->query_len)
+			history_search_find(history, search->match);
+		break;
+	case CTRL('G'):
+		history_search_end(history);
+		tinyrl_set_line(history->tinyrl, search->line);
+		return true;
+	case CTRL('H'):
+	case 127:
+		if (!search->query_len)
+			break;
+		search->query[--search->query_len] = '\0';
+		search->failed = false;
+		if (search->query_len) {
+			history_search_find(history, length);
+		} else {
+			search->match = length;
+			tinyrl_set_line(history->tinyrl, search->line);
+		}
+		break;
+	default:
+		if (key < ' ') {
+			history_search_end(history);
+			/* up and down go on from the entry found */
+			if (search->match < length)
+				history->iter = search->match;
+			return false;
+		}
+		if (search->query_len + 1 == sizeof(search->query)) {
+			tinyrl_ding(history->tinyrl);
+			break;
+		}
+		search->query[search->query_len++] = key;
+		search->query[search->query_len] = '\0';
+		/* the entry shown may still hold the longer query */
+		history_search_find(history, search->match < length ? search->match + 1 : length);
+		break;
+	}
+	history_search_show(history);
+	return true;
+}
+
+/*------------------------------------- */
+bool tinyrl_history_key_search(void *context, int key)
+{
+	struct tinyrl_history *history = context;
+	struct tinyrl_history_search *search = &history->search;
+	const char *line = tinyrl__get_line(history->tinyrl);
+
+	/* the entry shown may be moved or freed by the sync, edit a copy */
+	if (line && line == tinyrl_history_get(history, history->iter))
+		tinyrl_replace_line(history->tinyrl, line, 0);
+	/* the copy fails on a line too long, the history is then not synced */
+	if (tinyrl__get_line(history->tinyrl) != tinyrl_history_get(history, history->iter))
+		history_shared_sync(history);
+	search->query[0] = '\0';
+	search->query_len = 0;
+	search->failed = false;
+	search->match = tinyrl_history_length(history);
+	search->line = tinyrl__get_line(history->tinyrl);
+	search->prompt = tinyrl__get_prompt(history->tinyrl);
+	history_search_show(history);
+	tinyrl__set_key_filter(history->tinyrl, history_search_key, history);
+	return true;
+}
+
 /*------------------------------------- */
 struct tinyrl_history *tinyrl_history_new(tinyrl_t *tinyrl, unsigned limit)
 {
 	struct tinyrl_history *history;
        
-	history = malloc(sizeof(*history));
+	history = calloc(1, sizeof(*history));
 	if (!history)
 		return NULL;
 
 	history->tinyrl = tinyrl;
-	history->entries = NULL;
 	history->limit = limit;
-	history->length = 0;
-	history->size = 0;
-	history->iter = 0;
 
-	tinyrl_bind_special(tinyrl, TINYRL_KEY_UP, tinyrl_history_key_up, history);
-	tinyrl_bind_special(tinyrl, TINYRL_KEY_DOWN, tinyrl_history_key_down, history);
+	if (tinyrl) {
+		tinyrl_bind_special(tinyrl, TINYRL_KEY_UP, tinyrl_history_key_up, history);
+		tinyrl_bind_special(tinyrl, TINYRL_KEY_DOWN, tinyrl_history_key_down, history);
+		tinyrl_bind_key(tinyrl, CTRL('R'), tinyrl_history_key_search, history);
+	}
 	return history;
 }
 
 /*------------------------------------- */
 void tinyrl_history_delete(struct tinyrl_history *history)
 {
-	unsigned i;
-
-	for (i = 0; i < history->length; i++)
-		free(history->entries[i]);
-	free(history->entries);
+	if (history->file)
+		tinyrl_history_file_close(history->file);
+	if (history->map)
+		tinyrl_history_map_unref(history->map);
+	history_index_drop(history);
+	free(history->mapped_copy);
+	free(history->slab);
+	free(history->offsets);
 	free(history);
 }
 
+/*------------------------------------- */
+struct tinyrl_history *tinyrl_history_snapshot(const struct tinyrl_history *history)
+{
+	struct tinyrl_history *snapshot;
+
+	snapshot = tinyrl_history_new(NULL, history->limit);
+	if (!snapshot)
+		return NULL;
+
+	if (history->slab) {
+		snapshot->slab = malloc(history->slab_size);
+		snapshot->offsets = malloc(sizeof(*history->offsets) * history->slots);
+		if (!snapshot->slab || !snapshot->offsets) {
+			tinyrl_history_delete(snapshot);
+			return NULL;
+		}
+		memcpy(snapshot->slab, history->slab, history->slab_size);
+		memcpy(snapshot->offsets, history->offsets,
+		       sizeof(*history->offsets) * history->slots);
+		snapshot->slab_size = history->slab_size;
+		snapshot->slots = history->slots;
+	}
+	if (history->mapped_length) {
+		if (history->mapped_copy) {
+			/* the entries removed from the mapping are not copied */
+			snapshot->mapped_copy = malloc(sizeof(*history->mapped) * history->mapped_length);
+			if (!snapshot->mapped_copy) {
+				tinyrl_history_delete(snapshot);
+				return NULL;
+			}
+			memcpy(snapshot->mapped_copy, history->mapped + history->mapped_first,
+			       sizeof(*history->mapped) * history->mapped_length);
+			snapshot->mapped = snapshot->mapped_copy;
+		} else {
+			snapshot->mapped = history->mapped;
+			snapshot->mapped_first = history->mapped_first;
+		}
+		snapshot->map = tinyrl_history_map_ref(history->map);
+		snapshot->mapped_length = history->mapped_length;
+	}
+	snapshot->head = history->head;
+	snapshot->tail = history->tail;
+	snapshot->first = history->first;
+	snapshot->length = history->length;
+	snapshot->base = history->base;
+	snapshot->iter = tinyrl_history_length(snapshot);
+	return snapshot;
+}
+
 /*
    HISTORY LIST MANAGEMENT 
    */
+/*------------------------------------- */
+static size_t *entry_offset(const struct tinyrl_history *history, unsigned position)
+{
+	unsigned slot = history->first + position;
+
+	if (slot >= history->slots)
+		slot -= history->slots;
+	return &history->offsets[slot];
+}
+
+/*------------------------------------- */
+/* drop the oldest entry */
+static void remove_oldest(struct tinyrl_history *history)
+{
+	/* the postings of the entry are dropped as they are met */
+	history->base++;
+	if (history->mapped_length) {
+		history->mapped_first++;
+		history->mapped_length--;
+		return;
+	}
+	if (++history->first == history->slots)
+		history->first = 0;
+	if (--history->length)
+		history->tail = *entry_offset(history, 0);
+	else
+		history->head = history->tail = history->first = 0;
+}
+
 /*------------------------------------- */
 /*
- * This removes the specified entries from the 
- * entries vector. Shuffling up the array as necessary 
+ * Copy the entries, oldest first, to the start of a new slab of slab_size
+ * bytes with slots offsets. Both are only ever grown, so this happens a
+ * number of times logarithmic in the size of the history.
  */
-static void
-remove_entries(struct tinyrl_history *history, unsigned start, unsigned delta)
+static bool rebuild(struct tinyrl_history *history, size_t slab_size, unsigned slots)
 {
-	unsigned end = start + delta;
+	char *slab = malloc(slab_size);
+	size_t *offsets = malloc(sizeof(*offsets) * slots);
+	size_t head = 0;
 	unsigned i;
 
-	assert(end <= history->length);
+	if (!slab || !offsets) {
+		free(slab);
+		free(offsets);
+		return false;
+	}
+	for (i = 0; i < history->length; i++) {
+		const char *entry = history->slab + *entry_offset(history, i);
+		size_t len = strlen(entry) + 1;
 
-	for (i = start; i < end; i++)
-		free(history->entries[i]);
-	memmove(history->entries + start, history->entries + end,
-		sizeof(*history->entries) * (history->length - end));
-	history->length -= delta;
+		memcpy(slab + head, entry, len);
+		offsets[i] = head;
+		head += len;
+	}
+	free(history->slab);
+	free(history->offsets);
+	history->slab = slab;
+	history->slab_size = slab_size;
+	history->offsets = offsets;
+	history->slots = slots;
+	history->first = 0;
+	history->tail = 0;
+	history->head = head;
+	return true;
 }
 
 /*------------------------------------- */
-/* 
-   add an entry to the end of the current array 
-   if there is no space returns -1 else 0
-   */
-static void append_entry(struct tinyrl_history *history, const char *line)
+/* find room for len bytes in the slab, -1 if there is none */
+static size_t find_room(const struct tinyrl_history *history, size_t len)
 {
-	if (history->length < history->size) {
-		history->entries[history->length] = strdup(line);
-		history->length++;
+	if (!history->length)
+		return len <= history->slab_size ? 0 : (size_t) -1;
+	if (history->head > history->tail) {
+		/* the free space is after head and before tail */
+		if (history->slab_size - history->head >= len)
+			return history->head;
+		if (history->tail >= len)
+			return 0;
+	} else if (history->tail - history->head >= len) {
+		return history->head;
 	}
+	return (size_t) -1;
 }
 
 /*------------------------------------- */
-/* grow the array if necessary */
-static void grow(struct tinyrl_history *history)
+static void history_add(struct tinyrl_history *history, const char *line)
 {
-	if (history->size == history->length) {
-		/* increment the history memory by 10 entries each time we grow */
-		unsigned new_size = history->size + 10;
-		char **new_entries;
+	size_t len = strlen(line) + 1;
+	char *copy = NULL;
+	size_t offset;
+
+	if (history->slab && line >= history->slab
+	    && line < history->slab + history->slab_size) {
+		/* the line is an entry which may be moved or overwritten */
+		line = copy = strdup(line);
+		if (!copy)
+			return;
+	}
+
+	if (history->limit && (tinyrl_history_length(history) == history->limit)) {
+		/* remove the oldest entry */
+		remove_oldest(history);
+	}
+
+	offset = find_room(history, len);
+	if (offset == (size_t) -1 || history->length == history->slots) {
+		size_t slab_size = history->slab_size ? history->slab_size : HISTORY_SLAB_SIZE;
+		unsigned slots = history->slots ? history->slots : HISTORY_SLOTS;
 
-		new_entries = realloc(history->entries,
-				      sizeof(*history->entries) * new_size);
-		if (NULL != new_entries) {
-			history->size = new_size;
-			history->entries = new_entries;
+		/* the entries then take at most the old slab size plus the line */
+		if (offset == (size_t) -1) {
+			while (slab_size < history->slab_size + len)
+				slab_size *= 2;
 		}
+		if (history->length == history->slots)
+			slots *= 2;
+		if (!rebuild(history, slab_size, slots)) {
+			free(copy);
+			return;
+		}
+		offset = find_room(history, len);
 	}
+
+	memcpy(history->slab + offset, line, len);
+	*entry_offset(history, history->length) = offset;
+	if (!history->length)
+		history->tail = offset;
+	history->head = offset + len;
+	history->length++;
+
+	if (history->index && !history_index_add(history,
+			history->base + tinyrl_history_length(history) - 1, line))
+		history_index_drop(history);
+	if (history->file)
+		tinyrl_history_file_append(history->file, line, len, history->limit);
+	free(copy);
 }
 
 /*------------------------------------- */
 void tinyrl_history_add(struct tinyrl_history *history, const char *line)
 {
-	if (history->length && (history->length == history->limit)) {
-		/* remove the oldest entry */
-		remove_entries(history, 0, 1);
-	} else {
-		grow(history);
-	}
-	append_entry(history, line);
+	/* a line too long for a slot stays in this history only */
+	if (history->shared && strlen(line) < HISTORY_SHARED_LINE)
+		tinyrl_history_shared_add(history->shared, line);
+	else
+		history_add(history, line);
 }
 
 /*------------------------------------- */
 void tinyrl_history_remove(struct tinyrl_history *history, unsigned offset)
 {
+	unsigned i;
+
+	if (offset && offset < tinyrl_history_length(history)) {
+		/* the entries after it move, so do their sequence numbers */
+		history_index_drop(history);
+	}
+
+	if (offset < history->mapped_length) {
+		if (!history->mapped_copy) {
+			/* the mapping is shared, work on a copy of the offsets */
+			history->mapped_copy = malloc(sizeof(*history->mapped) * history->mapped_length);
+			if (!history->mapped_copy)
+				return;
+			memcpy(history->mapped_copy, history->mapped + history->mapped_first,
+			       sizeof(*history->mapped) * history->mapped_length);
+			history->mapped = history->mapped_copy;
+			history->mapped_first = 0;
+		}
+		memmove(history->mapped_copy + history->mapped_first + offset,
+			history->mapped_copy + history->mapped_first + offset + 1,
+			sizeof(*history->mapped) * (history->mapped_length - offset - 1));
+		history->mapped_length--;
+		return;
+	}
+	offset -= history->mapped_length;
 	if (offset < history->length) {
-		/* do the biz */
-		remove_entries(history, offset, 1);
+		if (!offset) {
+			remove_oldest(history);
+			return;
+		}
+		/* the text stays in the slab until the tail passes it */
+		for (i = offset; i + 1 < history->length; i++)
+			*entry_offset(history, i) = *entry_offset(history, i + 1);
+		history->length--;
 	}
 }
 
 /*------------------------------------- */
 void tinyrl_history_clear(struct tinyrl_history *history)
 {
-	/* free all the entries */
-	remove_entries(history, 0, history->length);
+	/* no posting is in use anymore */
+	history->base += tinyrl_history_length(history);
+
+	/* the file keeps its entries, only the history forgets them */
+	history->mapped_first += history->mapped_length;
+	history->mapped_length = 0;
+
+	/* the slab is kept for the next entries */
+	history->length = 0;
+	history->first = 0;
+	history->head = history->tail = 0;
 }
 
 /*------------------------------------- */
 void tinyrl_history_limit(struct tinyrl_history *history, unsigned limit)
 {
-	if (limit && limit < history->length)
-		remove_entries(history, 0, history->length - limit);
+	while (limit && limit < tinyrl_history_length(history))
+		remove_oldest(history);
 	history->limit = limit;
 }
 
@@ -176,12 +699,151 @@ void tinyrl_history_limit(struct tinyrl_history *history, unsigned limit)
 const char *tinyrl_history_get(const struct tinyrl_history *history,
 			       unsigned position)
 {
+	if (position < history->mapped_length)
+		return history->map->text + history->mapped[history->mapped_first + position];
+	position -= history->mapped_length;
 	if (position < history->length)
-		return history->entries[position];
+		return history->slab + *entry_offset(history, position);
 	return NULL;
 }
 
 size_t tinyrl_history_length(const struct tinyrl_history *history)
 {
-	return history->length;
+	return history->mapped_length + history->length;
+}
+
+/*
+   HISTORY FILE
+   */
+/*------------------------------------- */
+bool tinyrl_history_open(struct tinyrl_history *history, const char *path)
+{
+	struct tinyrl_history_map *map;
+	struct tinyrl_history_file *file;
+
+	if (history->file || history->map || tinyrl_history_length(history))
+		return false;
+
+	file = tinyrl_history_file_open(path, &map);
+	if (!file)
+		return false;
+
+	history_index_drop(history);
+	history->file = file;
+	history->map = map;
+	history->mapped = map->offsets;
+	history->mapped_first = 0;
+	history->mapped_length = map->length;
+	tinyrl_history_limit(history, history->limit);
+	history->iter = tinyrl_history_length(history);
+	return true;
+}
+
+/*
+   SHARED HISTORY
+   */
+/*------------------------------------- */
+struct tinyrl_history_shared *tinyrl_history_shared_new(unsigned size)
+{
+	struct tinyrl_history_shared *shared;
+
+	if (!size)
+		return NULL;
+	shared = calloc(1, sizeof(*shared) + sizeof(shared->slot[0]) * size);
+	if (!shared)
+		return NULL;
+	shared->size = size;
+	return shared;
+}
+
+/*------------------------------------- */
+void tinyrl_history_shared_delete(struct tinyrl_history_shared *shared)
+{
+	free(shared);
+}
+
+/*------------------------------------- */
+void tinyrl_history_shared_add(struct tinyrl_history_shared *shared, const char *line)
+{
+	size_t len = strlen(line);
+	struct tinyrl_history_slot *slot;
+	uint64_t seq, stamp;
+
+	if (len >= HISTORY_SHARED_LINE)
+		return;
+
+	seq = __atomic_fetch_add(&shared->head, 1, __ATOMIC_RELAXED);
+	slot = &shared->slot[seq % shared->size];
+	stamp = __atomic_load_n(&slot->stamp, __ATOMIC_RELAXED);
+	/*
+	 * The slot is taken unless a newer entry has it, or an entry one lap
+	 * older is still being written into it (its writer was held up while
+	 * size entries were added); the line is then dropped rather than
+	 * waiting for it.
+	 */
+	do {
+		if ((stamp & 1) || stamp > 2 * seq)
+			return;
+	} while (!__atomic_compare_exchange_n(&slot->stamp, &stamp, 2 * seq + 1, true,
+					      __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(slot->text, line, len + 1);
+	__atomic_store_n(&slot->stamp, 2 * seq + 2, __ATOMIC_RELEASE);
+}
+
+/*------------------------------------- */
+/*
+ * Copy the entries added to the shared history since the last call. This is
+ * only done when the user starts walking through the history, so the
+ * entries do not change under them. An entry still being written stops the
+ * copy until the next call, unless half a lap has been added since; it is
+ * then given up, as are the entries overwritten before they are read.
+ */
+static void history_shared_sync(struct tinyrl_history *history)
+{
+	struct tinyrl_history_shared *shared = history->shared;
+	char text[HISTORY_SHARED_LINE];
+	uint64_t head, seq;
+
+	if (!shared)
+		return;
+
+	head = __atomic_load_n(&shared->head, __ATOMIC_ACQUIRE);
+	seq = history->shared_next;
+	if (head - seq > shared->size)
+		seq = head - shared->size;
+
+	for (; seq < head; seq++) {
+		struct tinyrl_history_slot *slot = &shared->slot[seq % shared->size];
+		uint64_t stamp = __atomic_load_n(&slot->stamp, __ATOMIC_ACQUIRE);
+
+		if (stamp < 2 * seq + 2) {
+			if (head - seq <= shared->size / 2)
+				break;
+			continue;
+		}
+		if (stamp > 2 * seq + 2)
+			continue;
+
+		memcpy(text, slot->text, sizeof(text));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&slot->stamp, __ATOMIC_RELAXED) != stamp)
+			continue;
+		text[sizeof(text) - 1] = '\0';
+		history_add(history, text);
+	}
+	history->shared_next = seq;
+}
+
+/*------------------------------------- */
+void tinyrl_history_share(struct tinyrl_history *history,
+			  struct tinyrl_history_shared *shared)
+{
+	history->shared = shared;
+	history->shared_next = 0;
+	if (!shared)
+		return;
+	tinyrl_history_limit(history, shared->size);
+	history_shared_sync(history);
+	history->iter = tinyrl_history_length(history);
 }
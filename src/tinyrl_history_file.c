@@ -0,0 +1,536 @@
+/*
+ * history_file.c
+ *
+ * Append only history file, mapped in memory when it is opened
+ */
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "tinyrl_history_file.h"
+
+#define HISTORY_DATA_MAGIC "TRLHIST1"
+#define HISTORY_INDEX_MAGIC "TRLHIDX1"
+
+/* entries and seconds after which appended entries are flushed to disk */
+#define HISTORY_SYNC_ENTRIES 32
+#define HISTORY_SYNC_SECONDS 5
+
+/* entries to be dropped before a compaction is worth it */
+#define HISTORY_COMPACT_MIN 1024
+
+struct tinyrl_history_header {
+	char magic[8];
+	uint64_t generation;
+};
+
+#define HISTORY_HEADER_SIZE sizeof(struct tinyrl_history_header)
+
+enum tinyrl_history_compaction {
+	HISTORY_COMPACT_IDLE,
+	HISTORY_COMPACT_RUNNING,
+	HISTORY_COMPACT_DONE,
+	HISTORY_COMPACT_FAILED
+};
+
+struct tinyrl_history_file {
+	char *path;
+	char *index_path;
+	int fd;			/* data file */
+	int index_fd;
+	uint64_t generation;
+	uint64_t size;		/* bytes of the data file */
+	unsigned count;		/* entries in the file */
+	unsigned unsynced;	/* entries appended since the last sync */
+	time_t synced;
+
+	/* compaction, the fields below are set before the thread starts */
+	pthread_t thread;
+	int state;		/* enum tinyrl_history_compaction, atomic */
+	unsigned from;		/* first entry kept */
+	unsigned until;		/* entries in the file when it started */
+	uint64_t until_size;
+	uint64_t start;		/* offset of entry from */
+	int new_fd;
+	int new_index_fd;
+	unsigned retry;		/* entries before trying again after a failure */
+};
+
+/*------------------------------------- */
+static void history_file_error(const char *path, const char *what)
+{
+	fprintf(stdout, "History file %s: %s failed. ERR=%u.\n\r", path, what, errno);
+}
+
+/*------------------------------------- */
+static bool write_all(int fd, const void *buf, size_t len, uint64_t offset)
+{
+	const char *p = buf;
+
+	while (len) {
+		ssize_t n = pwrite(fd, p, len, offset);
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		p += n;
+		len -= n;
+		offset += n;
+	}
+	return true;
+}
+
+/*------------------------------------- */
+static bool read_all(int fd, void *buf, size_t len, uint64_t offset)
+{
+	char *p = buf;
+
+	while (len) {
+		ssize_t n = pread(fd, p, len, offset);
+
+		if (n <= 0) {
+			if (n < 0 && errno == EINTR)
+				continue;
+			return false;
+		}
+		p += n;
+		len -= n;
+		offset += n;
+	}
+	return true;
+}
+
+/*------------------------------------- */
+static bool write_header(int fd, const char *magic, uint64_t generation)
+{
+	struct tinyrl_history_header header;
+
+	memcpy(header.magic, magic, sizeof(header.magic));
+	header.generation = generation;
+	return write_all(fd, &header, sizeof(header), 0);
+}
+
+/*------------------------------------- */
+static bool read_header(int fd, const char *magic, uint64_t *generation)
+{
+	struct tinyrl_history_header header;
+
+	if (!read_all(fd, &header, sizeof(header), 0)
+	    || memcmp(header.magic, magic, sizeof(header.magic)))
+		return false;
+	*generation = header.generation;
+	return true;
+}
+
+/*------------------------------------- */
+/*
+ * Rebuild the index from the data file, the entries are found by scanning
+ * for their null terminators. Anything after the last complete entry is
+ * cut from the data file.
+ */
+static bool history_file_rebuild_index(struct tinyrl_history_file *file,
+				       struct tinyrl_history_map *map)
+{
+	uint64_t *offsets = NULL;
+	unsigned size = 0, count = 0;
+	const char *text = map->text;
+	uint64_t offset = HISTORY_HEADER_SIZE;
+	const char *end;
+
+	while (offset < map->text_size
+	       && (end = memchr(text + offset, '\0', map->text_size - offset))) {
+		if (count == size) {
+			uint64_t *grown;
+
+			size = size ? size * 2 : 1024;
+			grown = realloc(offsets, sizeof(*offsets) * size);
+			if (!grown) {
+				free(offsets);
+				return false;
+			}
+			offsets = grown;
+		}
+		offsets[count++] = offset;
+		offset = end - text + 1;
+	}
+
+	if (offset != map->text_size && ftruncate(file->fd, offset))
+		history_file_error(file->path, "truncate");
+	if (ftruncate(file->index_fd, 0)
+	    || !write_header(file->index_fd, HISTORY_INDEX_MAGIC, file->generation)
+	    || !write_all(file->index_fd, offsets, sizeof(*offsets) * count,
+			  HISTORY_HEADER_SIZE))
+		history_file_error(file->index_path, "rebuild");
+
+	map->offsets = offsets;
+	map->length = count;
+	file->size = offset;
+	file->count = count;
+	return true;
+}
+
+/*------------------------------------- */
+/*
+ * Map the index file. It is used as it is if it matches the data file, that
+ * is if it has the same generation and its last entry ends the data file.
+ */
+static bool history_file_map_index(struct tinyrl_history_file *file,
+				   struct tinyrl_history_map *map)
+{
+	struct stat st;
+	uint64_t generation, last;
+	const uint64_t *offsets;
+	const char *end;
+	unsigned count;
+
+	if (fstat(file->index_fd, &st) || st.st_size < (off_t) HISTORY_HEADER_SIZE
+	    || (st.st_size - HISTORY_HEADER_SIZE) % sizeof(uint64_t)
+	    || !read_header(file->index_fd, HISTORY_INDEX_MAGIC, &generation)
+	    || generation != file->generation)
+		return false;
+
+	count = (st.st_size - HISTORY_HEADER_SIZE) / sizeof(uint64_t);
+	if (!count) {
+		file->size = HISTORY_HEADER_SIZE;
+		return map->text_size == HISTORY_HEADER_SIZE;
+	}
+
+	map->index = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, file->index_fd, 0);
+	if (map->index == MAP_FAILED) {
+		map->index = NULL;
+		return false;
+	}
+	map->index_size = st.st_size;
+	offsets = (const uint64_t *) ((const char *) map->index + HISTORY_HEADER_SIZE);
+
+	last = offsets[count - 1];
+	if (last < HISTORY_HEADER_SIZE || last >= map->text_size
+	    || !(end = memchr(map->text + last, '\0', map->text_size - last))
+	    || end != map->text + map->text_size - 1) {
+		munmap(map->index, map->index_size);
+		map->index = NULL;
+		return false;
+	}
+
+	map->offsets = offsets;
+	map->length = count;
+	file->size = map->text_size;
+	file->count = count;
+	return true;
+}
+
+/*------------------------------------- */
+struct tinyrl_history_file *tinyrl_history_file_open(const char *path,
+	struct tinyrl_history_map **mapp)
+{
+	struct tinyrl_history_file *file;
+	struct tinyrl_history_map *map;
+	struct stat st;
+
+	file = calloc(1, sizeof(*file));
+	map = calloc(1, sizeof(*map));
+	if (!file || !map)
+		goto fail;
+	file->fd = file->index_fd = -1;
+	file->path = strdup(path);
+	file->index_path = malloc(strlen(path) + sizeof(".idx"));
+	if (!file->path || !file->index_path)
+		goto fail;
+	strcat(strcpy(file->index_path, path), ".idx");
+
+	file->fd = open(file->path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	file->index_fd = open(file->index_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (file->fd < 0 || file->index_fd < 0 || fstat(file->fd, &st)) {
+		history_file_error(path, "open");
+		goto fail;
+	}
+	/* two processes appending to the same file would mix their entries */
+	if (flock(file->fd, LOCK_EX | LOCK_NB)) {
+		history_file_error(path, "lock");
+		goto fail;
+	}
+	if (!st.st_size) {
+		/* new history */
+		file->generation = 1;
+		if (!write_header(file->fd, HISTORY_DATA_MAGIC, file->generation)) {
+			history_file_error(path, "write");
+			goto fail;
+		}
+		st.st_size = HISTORY_HEADER_SIZE;
+	} else if (st.st_size < (off_t) HISTORY_HEADER_SIZE
+		   || !read_header(file->fd, HISTORY_DATA_MAGIC, &file->generation)) {
+		fprintf(stdout, "History file %s: not a history file.\n\r", path);
+		goto fail;
+	}
+
+	map->refs = 1;
+	map->text_size = st.st_size;
+	map->text = mmap(NULL, map->text_size, PROT_READ, MAP_SHARED, file->fd, 0);
+	if (map->text == MAP_FAILED) {
+		map->text = NULL;
+		history_file_error(path, "mmap");
+		goto fail;
+	}
+
+	if (!history_file_map_index(file, map)
+	    && !history_file_rebuild_index(file, map))
+		goto fail;
+
+	file->synced = time(NULL);
+	*mapp = map;
+	return file;
+
+fail:
+	if (map) {
+		map->refs = 1;
+		tinyrl_history_map_unref(map);
+	}
+	if (file) {
+		if (file->fd >= 0)
+			close(file->fd);
+		if (file->index_fd >= 0)
+			close(file->index_fd);
+		free(file->path);
+		free(file->index_path);
+		free(file);
+	}
+	return NULL;
+}
+
+/*------------------------------------- */
+static char *tmp_path(const char *path)
+{
+	char *tmp = malloc(strlen(path) + sizeof(".tmp"));
+
+	if (tmp)
+		strcat(strcpy(tmp, path), ".tmp");
+	return tmp;
+}
+
+/*------------------------------------- */
+/*
+ * Compaction thread: copy the entries from file->from to file->until to new
+ * files, which are swapped in by the thread appending once it is done.
+ */
+static void *history_file_compact(void *arg)
+{
+	struct tinyrl_history_file *file = arg;
+	unsigned count = file->until - file->from;
+	uint64_t *offsets = malloc(sizeof(*offsets) * count);
+	void *text = MAP_FAILED;
+	int state = HISTORY_COMPACT_FAILED;
+	unsigned i;
+
+	if (!offsets
+	    || !read_all(file->index_fd, offsets, sizeof(*offsets) * count,
+			 HISTORY_HEADER_SIZE + sizeof(*offsets) * file->from))
+		goto out;
+	text = mmap(NULL, file->until_size, PROT_READ, MAP_SHARED, file->fd, 0);
+	if (text == MAP_FAILED)
+		goto out;
+
+	file->start = offsets[0];
+	for (i = 0; i < count; i++)
+		offsets[i] = offsets[i] - file->start + HISTORY_HEADER_SIZE;
+
+	if (write_header(file->new_fd, HISTORY_DATA_MAGIC, file->generation + 1)
+	    && write_all(file->new_fd, (char *) text + file->start,
+			 file->until_size - file->start, HISTORY_HEADER_SIZE)
+	    && write_header(file->new_index_fd, HISTORY_INDEX_MAGIC, file->generation + 1)
+	    && write_all(file->new_index_fd, offsets, sizeof(*offsets) * count,
+			 HISTORY_HEADER_SIZE)
+	    && !fdatasync(file->new_fd) && !fdatasync(file->new_index_fd))
+		state = HISTORY_COMPACT_DONE;
+
+out:
+	if (text != MAP_FAILED)
+		munmap(text, file->until_size);
+	free(offsets);
+	__atomic_store_n(&file->state, state, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+/*------------------------------------- */
+static void history_file_compact_start(struct tinyrl_history_file *file, unsigned keep)
+{
+	char *data_tmp = tmp_path(file->path);
+	char *index_tmp = tmp_path(file->index_path);
+
+	file->new_fd = file->new_index_fd = -1;
+	if (data_tmp && index_tmp) {
+		file->new_fd = open(data_tmp, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+		file->new_index_fd = open(index_tmp, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	}
+	free(data_tmp);
+	free(index_tmp);
+	/* the new file is locked before it takes the place of the old one */
+	if (file->new_fd < 0 || file->new_index_fd < 0
+	    || flock(file->new_fd, LOCK_EX | LOCK_NB)) {
+		history_file_error(file->path, "compaction");
+		file->retry = file->count + HISTORY_COMPACT_MIN;
+		if (file->new_fd >= 0)
+			close(file->new_fd);
+		if (file->new_index_fd >= 0)
+			close(file->new_index_fd);
+		return;
+	}
+
+	/* the appends made meanwhile do not touch what the thread reads */
+	file->from = file->count - keep;
+	file->until = file->count;
+	file->until_size = file->size;
+	file->state = HISTORY_COMPACT_RUNNING;
+	if (pthread_create(&file->thread, NULL, history_file_compact, file)) {
+		history_file_error(file->path, "compaction");
+		file->state = HISTORY_COMPACT_FAILED;
+		file->thread = pthread_self();
+	}
+}
+
+/*------------------------------------- */
+/*
+ * Complete a compaction: the entries appended since it started are copied
+ * to the new files, which then replace the old ones. The data file is
+ * renamed first, an index left behind does not match its generation and
+ * is rebuilt when the history is opened again.
+ */
+static void history_file_compact_finish(struct tinyrl_history_file *file)
+{
+	char buf[4096];
+	uint64_t offset, new_size;
+	unsigned i, count;
+	char *data_tmp = NULL, *index_tmp = NULL;
+	bool ok = file->state == HISTORY_COMPACT_DONE;
+
+	if (!pthread_equal(file->thread, pthread_self()))
+		pthread_join(file->thread, NULL);
+
+	new_size = file->until_size - file->start + HISTORY_HEADER_SIZE;
+	for (offset = file->until_size; ok && offset < file->size; offset += count) {
+		count = file->size - offset < sizeof(buf) ? file->size - offset : sizeof(buf);
+		ok = read_all(file->fd, buf, count, offset)
+		    && write_all(file->new_fd, buf, count, new_size + offset - file->until_size);
+	}
+	for (i = file->until; ok && i < file->count; i++) {
+		ok = read_all(file->index_fd, &offset, sizeof(offset),
+			      HISTORY_HEADER_SIZE + sizeof(offset) * i);
+		offset = offset - file->start + HISTORY_HEADER_SIZE;
+		ok = ok && write_all(file->new_index_fd, &offset, sizeof(offset),
+				     HISTORY_HEADER_SIZE + sizeof(offset) * (i - file->from));
+	}
+
+	data_tmp = tmp_path(file->path);
+	index_tmp = tmp_path(file->index_path);
+	ok = ok && data_tmp && index_tmp
+	    && !rename(data_tmp, file->path) && !rename(index_tmp, file->index_path);
+	if (ok) {
+		close(file->fd);
+		close(file->index_fd);
+		file->fd = file->new_fd;
+		file->index_fd = file->new_index_fd;
+		file->size = file->size - file->start + HISTORY_HEADER_SIZE;
+		file->count -= file->from;
+		file->generation++;
+	} else {
+		history_file_error(file->path, "compaction");
+		file->retry = file->count + HISTORY_COMPACT_MIN;
+		close(file->new_fd);
+		close(file->new_index_fd);
+		if (data_tmp)
+			unlink(data_tmp);
+		if (index_tmp)
+			unlink(index_tmp);
+	}
+	free(data_tmp);
+	free(index_tmp);
+	file->state = HISTORY_COMPACT_IDLE;
+}
+
+/*------------------------------------- */
+void tinyrl_history_file_sync(struct tinyrl_history_file *file)
+{
+	if (fdatasync(file->fd) || fdatasync(file->index_fd))
+		history_file_error(file->path, "sync");
+	file->unsynced = 0;
+	file->synced = time(NULL);
+}
+
+/*------------------------------------- */
+/*
+ * All the writes to the history go through here: the entry is written
+ * after the last one, then its offset to the index.
+ */
+void tinyrl_history_file_append(struct tinyrl_history_file *file,
+	const char *line, size_t len, unsigned keep)
+{
+	uint64_t offset;
+
+	if (__atomic_load_n(&file->state, __ATOMIC_ACQUIRE) >= HISTORY_COMPACT_DONE)
+		history_file_compact_finish(file);
+
+	offset = file->size;
+
+	if (!write_all(file->fd, line, len, offset)) {
+		history_file_error(file->path, "write");
+		return;
+	}
+	/* an index left short is rebuilt when the history is opened again */
+	if (!write_all(file->index_fd, &offset, sizeof(offset),
+		       HISTORY_HEADER_SIZE + sizeof(offset) * file->count))
+		history_file_error(file->index_path, "write");
+	file->size += len;
+	file->count++;
+
+	if (++file->unsynced >= HISTORY_SYNC_ENTRIES
+	    || time(NULL) - file->synced >= HISTORY_SYNC_SECONDS)
+		tinyrl_history_file_sync(file);
+
+	if (keep && file->count >= 2 * keep && file->count - keep >= HISTORY_COMPACT_MIN
+	    && file->count >= file->retry && file->state == HISTORY_COMPACT_IDLE)
+		history_file_compact_start(file, keep);
+}
+
+/*------------------------------------- */
+void tinyrl_history_file_close(struct tinyrl_history_file *file)
+{
+	if (file->state != HISTORY_COMPACT_IDLE)
+		history_file_compact_finish(file);
+	tinyrl_history_file_sync(file);
+	close(file->fd);
+	close(file->index_fd);
+	free(file->path);
+	free(file->index_path);
+	free(file);
+}
+
+/*------------------------------------- */
+struct tinyrl_history_map *tinyrl_history_map_ref(struct tinyrl_history_map *map)
+{
+	__atomic_add_fetch(&map->refs, 1, __ATOMIC_RELAXED);
+	return map;
+}
+
+/*------------------------------------- */
+void tinyrl_history_map_unref(struct tinyrl_history_map *map)
+{
+	if (__atomic_sub_fetch(&map->refs, 1, __ATOMIC_ACQ_REL))
+		return;
+	if (map->text)
+		munmap((void *) map->text, map->text_size);
+	if (map->index)
+		munmap(map->index, map->index_size);
+	else
+		free((void *) map->offsets);
+	free(map);
+}
@@ -0,0 +1,150 @@
+/*
+ * provider.c
+ *
+ * Values of an argument, fetched in the background and cached
+ */
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "tinyrl_provider.h"
+
+struct tinyrl_provider {
+	tinyrl_provider_func_t *func;
+	void *context;
+	unsigned ttl;		/* milliseconds, 0 for ever */
+
+	/* the fields below are protected by lock */
+	pthread_mutex_t lock;
+	struct tinyrl_provider_values *values;	/* NULL until fetched */
+	struct timespec fetched;	/* when the values were fetched */
+	bool fetching;
+	bool joinable;		/* thread has to be joined */
+	pthread_t thread;	/* last fetch */
+};
+
+/*------------------------------------- */
+static bool provider_expired(const struct tinyrl_provider *provider)
+{
+	struct timespec now;
+	long long elapsed;
+
+	if (!provider->values)
+		return true;
+	if (!provider->ttl)
+		return false;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed = (now.tv_sec - provider->fetched.tv_sec) * 1000LL
+		+ (now.tv_nsec - provider->fetched.tv_nsec) / 1000000;
+	return elapsed >= provider->ttl;
+}
+
+/*------------------------------------- */
+static void *provider_fetch(void *arg)
+{
+	struct tinyrl_provider *provider = arg;
+	struct tinyrl_provider_values *values, *old = NULL;
+
+	values = malloc(sizeof(*values));
+	if (values) {
+		values->refs = 1;
+		values->radix = tinyrl_radix_new();
+	}
+	if (values && values->radix
+	    && provider->func(provider->context, values->radix)) {
+		pthread_mutex_lock(&provider->lock);
+		old = provider->values;
+		provider->values = values;
+		clock_gettime(CLOCK_MONOTONIC, &provider->fetched);
+		provider->fetching = false;
+		pthread_mutex_unlock(&provider->lock);
+	} else {
+		if (values)
+			tinyrl_radix_delete(values->radix);
+		free(values);
+		pthread_mutex_lock(&provider->lock);
+		provider->fetching = false;
+		pthread_mutex_unlock(&provider->lock);
+	}
+
+	/* the sessions using the old values still hold them */
+	if (old)
+		tinyrl_provider_release(old);
+	return NULL;
+}
+
+/*------------------------------------- */
+/* called with the lock held */
+static void provider_start(struct tinyrl_provider *provider)
+{
+	if (provider->fetching)
+		return;
+	/* the previous fetch is over, its thread only has to be reaped */
+	if (provider->joinable)
+		pthread_join(provider->thread, NULL);
+	provider->fetching = true;
+	provider->joinable = !pthread_create(&provider->thread, NULL,
+					     provider_fetch, provider);
+	if (!provider->joinable)
+		provider->fetching = false;
+}
+
+/*------------------------------------- */
+struct tinyrl_provider *tinyrl_provider_new(tinyrl_provider_func_t *func,
+					    void *context, unsigned ttl)
+{
+	struct tinyrl_provider *provider = calloc(1, sizeof(*provider));
+
+	if (!provider)
+		return NULL;
+	provider->func = func;
+	provider->context = context;
+	provider->ttl = ttl;
+	pthread_mutex_init(&provider->lock, NULL);
+	return provider;
+}
+
+/*------------------------------------- */
+void tinyrl_provider_delete(struct tinyrl_provider *provider)
+{
+	if (!provider)
+		return;
+	if (provider->joinable)
+		pthread_join(provider->thread, NULL);
+	if (provider->values)
+		tinyrl_provider_release(provider->values);
+	pthread_mutex_destroy(&provider->lock);
+	free(provider);
+}
+
+/*------------------------------------- */
+void tinyrl_provider_refresh(struct tinyrl_provider *provider)
+{
+	pthread_mutex_lock(&provider->lock);
+	provider_start(provider);
+	pthread_mutex_unlock(&provider->lock);
+}
+
+/*------------------------------------- */
+struct tinyrl_provider_values *tinyrl_provider_get(struct tinyrl_provider *provider)
+{
+	struct tinyrl_provider_values *values;
+
+	pthread_mutex_lock(&provider->lock);
+	if (provider_expired(provider))
+		provider_start(provider);
+	values = provider->values;
+	if (values)
+		__atomic_add_fetch(&values->refs, 1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&provider->lock);
+	return values;
+}
+
+/*------------------------------------- */
+void tinyrl_provider_release(struct tinyrl_provider_values *values)
+{
+	if (__atomic_sub_fetch(&values->refs, 1, __ATOMIC_ACQ_REL))
+		return;
+	tinyrl_radix_delete(values->radix);
+	free(values);
+}
@@ -0,0 +1,283 @@
+/*
+ * radix.c
+ *
+ * Radix tree of words, for command lookup and completion
+ */
+#include <string.h>
+#include <stdlib.h>
+
+#include "tinyrl_radix.h"
+
+/*
+ * A node stands for the words starting with the labels of the edges from
+ * the root down to it. The label of a node is the edge from its parent, it
+ * points into one of the words copied in the tree. The children are sorted
+ * by the first byte of their label, no two of them share it.
+ */
+struct tinyrl_radix_node {
+	const char *label;
+	size_t label_len;
+	unsigned count;		/* words in this subtree */
+	const char *word;	/* the word ending here, NULL if none */
+	void *value;
+	struct tinyrl_radix_node **child;
+	unsigned children;
+};
+
+struct tinyrl_radix {
+	struct tinyrl_radix_node root;
+};
+
+/*------------------------------------- */
+struct tinyrl_radix *tinyrl_radix_new(void)
+{
+	return calloc(1, sizeof(struct tinyrl_radix));
+}
+
+/*------------------------------------- */
+static void radix_node_free(struct tinyrl_radix_node *node)
+{
+	unsigned i;
+
+	for (i = 0; i < node->children; i++) {
+		radix_node_free(node->child[i]);
+		free(node->child[i]);
+	}
+	free(node->child);
+	/* the word ending here owns its copy */
+	free((char *) node->word);
+}
+
+/*------------------------------------- */
+void tinyrl_radix_delete(struct tinyrl_radix *radix)
+{
+	if (!radix)
+		return;
+	radix_node_free(&radix->root);
+	free(radix);
+}
+
+/*------------------------------------- */
+/* binary search of the child whose label starts with c */
+static unsigned radix_child_index(const struct tinyrl_radix_node *node,
+				  unsigned char c)
+{
+	unsigned low = 0, high = node->children;
+
+	while (low < high) {
+		unsigned middle = low + (high - low) / 2;
+
+		if ((unsigned char) node->child[middle]->label[0] < c)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low;
+}
+
+/*------------------------------------- */
+static struct tinyrl_radix_node *radix_child(const struct tinyrl_radix_node *node,
+					     unsigned char c)
+{
+	unsigned i = radix_child_index(node, c);
+
+	if (i < node->children && (unsigned char) node->child[i]->label[0] == c)
+		return node->child[i];
+	return NULL;
+}
+
+/*------------------------------------- */
+static bool radix_add_child(struct tinyrl_radix_node *node,
+			    struct tinyrl_radix_node *child)
+{
+	unsigned i = radix_child_index(node, child->label[0]);
+	struct tinyrl_radix_node **grown;
+
+	grown = realloc(node->child, sizeof(*grown) * (node->children + 1));
+	if (!grown)
+		return false;
+	memmove(grown + i + 1, grown + i, sizeof(*grown) * (node->children - i));
+	grown[i] = child;
+	node->child = grown;
+	node->children++;
+	return true;
+}
+
+/*------------------------------------- */
+/*
+ * Follow the len first bytes of prefix down the tree. Returns the node whose
+ * subtree holds the words starting with the prefix, NULL if there is none;
+ * *rest is set to the bytes of its label past the prefix.
+ */
+static const struct tinyrl_radix_node *radix_descend(const struct tinyrl_radix *radix,
+						     const char *prefix, size_t len,
+						     size_t *rest)
+{
+	const struct tinyrl_radix_node *node = &radix->root;
+	size_t pos = 0, n = 0;
+
+	while (pos < len) {
+		node = radix_child(node, prefix[pos]);
+		if (!node)
+			return NULL;
+		n = node->label_len < len - pos ? node->label_len : len - pos;
+		if (memcmp(node->label, prefix + pos, n))
+			return NULL;
+		pos += n;
+	}
+	*rest = pos ? node->label_len - n : 0;
+	return node;
+}
+
+/*------------------------------------- */
+bool tinyrl_radix_insert(struct tinyrl_radix *radix, const char *word, void *value)
+{
+	struct tinyrl_radix_node *node = &radix->root;
+	size_t len = strlen(word), pos = 0;
+	char *copy;
+
+	while (pos < len) {
+		struct tinyrl_radix_node *child = radix_child(node, word[pos]);
+		size_t common;
+
+		if (!child)
+			break;
+		for (common = 1; common < child->label_len && pos + common < len; common++)
+			if (child->label[common] != word[pos + common])
+				break;
+		if (common < child->label_len) {
+			/* split the edge where the word leaves it */
+			struct tinyrl_radix_node *middle = calloc(1, sizeof(*middle));
+
+			if (!middle)
+				return false;
+			middle->child = malloc(sizeof(*middle->child));
+			if (!middle->child) {
+				free(middle);
+				return false;
+			}
+			middle->label = child->label;
+			middle->label_len = common;
+			middle->count = child->count;
+			middle->child[0] = child;
+			middle->children = 1;
+			node->child[radix_child_index(node, child->label[0])] = middle;
+			child->label += common;
+			child->label_len -= common;
+			child = middle;
+		}
+		node = child;
+		pos += common;
+	}
+
+	if (pos == len && node->word) {
+		node->value = value;
+		return true;
+	}
+
+	copy = strdup(word);
+	if (!copy)
+		return false;
+	if (pos < len) {
+		struct tinyrl_radix_node *leaf = calloc(1, sizeof(*leaf));
+
+		if (leaf) {
+			leaf->label = copy + pos;
+			leaf->label_len = len - pos;
+		}
+		if (!leaf || !radix_add_child(node, leaf)) {
+			free(leaf);
+			free(copy);
+			return false;
+		}
+		node = leaf;
+	}
+	node->word = copy;
+	node->value = value;
+
+	/* one more word below each node of its path */
+	for (node = &radix->root, pos = 0;; pos += node->label_len) {
+		node->count++;
+		if (pos == len)
+			break;
+		node = radix_child(node, word[pos]);
+	}
+	return true;
+}
+
+/*------------------------------------- */
+void tinyrl_radix_prefix(const struct tinyrl_radix *radix, const char *prefix,
+			 size_t len, struct tinyrl_radix_range *range)
+{
+	const struct tinyrl_radix_node *node;
+	size_t rest;
+
+	range->count = 0;
+	range->word = NULL;
+	range->common = len;
+	range->complete = false;
+
+	node = radix_descend(radix, prefix, len, &rest);
+	if (!node || !node->count)
+		return;
+
+	/* the words share the labels down to the first node which forks */
+	range->common += rest;
+	while (!node->word && node->children == 1) {
+		node = node->child[0];
+		range->common += node->label_len;
+	}
+	range->count = node->count;
+	range->complete = node->word != NULL;
+	while (!node->word)
+		node = node->child[0];
+	range->word = node->word;
+}
+
+/*------------------------------------- */
+void *tinyrl_radix_match(const struct tinyrl_radix *radix, const char *word,
+			 size_t len, unsigned *count)
+{
+	const struct tinyrl_radix_node *node;
+	size_t rest;
+
+	node = radix_descend(radix, word, len, &rest);
+	*count = node ? node->count : 0;
+	if (!node)
+		return NULL;
+
+	/* an exact match wins over the longer words */
+	if (!rest && node->word)
+		return node->value;
+	if (node->count != 1)
+		return NULL;
+	while (!node->word)
+		node = node->child[0];
+	return node->value;
+}
+
+/*------------------------------------- */
+static bool radix_walk(const struct tinyrl_radix_node *node,
+		       tinyrl_radix_func_t *func, void *context)
+{
+	unsigned i;
+
+	if (node->word && !func(context, node->word, node->value))
+		return false;
+	for (i = 0; i < node->children; i++)
+		if (!radix_walk(node->child[i], func, context))
+			return false;
+	return true;
+}
+
+/*------------------------------------- */
+void tinyrl_radix_walk(const struct tinyrl_radix *radix, const char *prefix,
+		       size_t len, tinyrl_radix_func_t *func, void *context)
+{
+	const struct tinyrl_radix_node *node;
+	size_t rest;
+
+	node = radix_descend(radix, prefix, len, &rest);
+	if (node)
+		radix_walk(node, func, context);
+}
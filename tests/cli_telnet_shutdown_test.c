@@ -0,0 +1,126 @@
+/*
+ * cli_telnet_shutdown_test.c
+ *
+ * The telnet workers stop when cli_telnet_deinit() is called while they
+ * wait for events, and close the sessions they serve, with both transports. Built and run from the top of
+ * the tree, once as is and once with the io_uring transport:
+ *
+ *     cc -Iinclude -o cli_telnet_shutdown_test tests/cli_telnet_shutdown_test.c \
+ *        src/cli_*.c src/tinyrl*.c -lpthread && ./cli_telnet_shutdown_test
+ *     cc -Iinclude -DCLI_TELNET_IO_URING -o cli_telnet_shutdown_test \
+ *        tests/cli_telnet_shutdown_test.c src/cli_*.c src/tinyrl*.c -lpthread \
+ *        && ./cli_telnet_shutdown_test
+ *
+ * The test listens on the telnet port (2023), which must be free.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+
+#include "main.h"
+
+/* the application commands, linked from main.c by the application */
+void cli_command_1(tinyrl_t * this, int argc, const cli_token_t *argv)
+{
+}
+
+void cli_command_2(tinyrl_t * this, int argc, const cli_token_t *argv)
+{
+}
+
+void cli_quit_application(void)
+{
+}
+
+/*------------------------------------- */
+static int connect_session(void)
+{
+	struct sockaddr_in addr;
+	char buf[256];
+	size_t len = 0;
+	unsigned retry;
+	ssize_t n;
+	int fd;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(2023);
+
+	/* the workers open their socket in the background */
+	for (retry = 0; retry < 50; retry++) {
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (fd < 0)
+			return -1;
+		if (!connect(fd, (struct sockaddr *) &addr, sizeof(addr)))
+			break;
+		close(fd);
+		fd = -1;
+		usleep(100000);
+	}
+	if (fd < 0)
+		return -1;
+
+	/* the session is served once its prompt is received */
+	while (len < sizeof(buf) - 1 && (n = read(fd, buf + len, sizeof(buf) - 1 - len)) > 0) {
+		len += n;
+		buf[len] = '\0';
+		if (strstr(buf, "CLI> "))
+			return fd;
+	}
+	close(fd);
+	return -1;
+}
+
+#define TEST_SESSIONS 3
+
+/*------------------------------------- */
+int main(void)
+{
+	int fds[TEST_SESSIONS];
+	char buf[256];
+	unsigned i;
+	ssize_t n;
+	int failed = 0;
+
+	/* a worker which does not stop fails by the alarm */
+	alarm(10);
+
+	if (cli_command_init()) {
+		fprintf(stderr, "FAIL: cli_command_init\n");
+		return EXIT_FAILURE;
+	}
+	cli_telnet_set_workers(2);
+	if (cli_telnet_init()) {
+		fprintf(stderr, "FAIL: cli_telnet_init\n");
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < TEST_SESSIONS; i++) {
+		fds[i] = connect_session();
+		if (fds[i] < 0) {
+			fprintf(stderr, "FAIL: no telnet session\n");
+			return EXIT_FAILURE;
+		}
+	}
+
+	cli_telnet_deinit();
+	cli_command_deinit();
+
+	/* a session left open blocks here until the alarm */
+	for (i = 0; i < TEST_SESSIONS; i++) {
+		while ((n = read(fds[i], buf, sizeof(buf))) > 0)
+			;
+		if (n < 0) {
+			fprintf(stderr, "FAIL: session %u not closed cleanly\n", i);
+			failed = 1;
+		}
+		close(fds[i]);
+	}
+
+	if (!failed)
+		printf("\nPASS\n");
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,158 @@
+/*
+ * tinyrl_complete_test.c
+ *
+ * Completion display on a terminal narrower than the matches, as a telnet
+ * client may report over NAWS, and fuzzy completion of a fragment typed a
+ * byte at a time. Built and run from the top of the tree:
+ *
+ *     cc -Iinclude -o tinyrl_complete_test tests/tinyrl_complete_test.c \
+ *        src/tinyrl*.c -lpthread && ./tinyrl_complete_test
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tinyrl.h"
+#include "tinyrl_complete.h"
+
+/* output of the instance, as sent */
+static char output[4096];
+static size_t output_len;
+
+/*------------------------------------- */
+static ssize_t test_write(void *context, const char *buf, size_t len)
+{
+	if (len > sizeof(output) - output_len)
+		len = sizeof(output) - output_len;
+	memcpy(output + output_len, buf, len);
+	output_len += len;
+	return len;
+}
+
+/*------------------------------------- */
+static unsigned count_lines(const char *text, size_t len, const char *word)
+{
+	unsigned lines = 0;
+	size_t i, word_len = strlen(word);
+
+	for (i = 0; i + word_len <= len; i++)
+		if (!memcmp(text + i, word, word_len))
+			lines++;
+	return lines;
+}
+
+/* words completed by the tab key */
+static struct tinyrl_fuzzy *fuzzy;
+
+/*------------------------------------- */
+static bool fuzzy_key(void *context, int key)
+{
+	tinyrl_t *t = context;
+
+	return tinyrl_complete_fuzzy(t, 0, fuzzy, 16);
+}
+
+/*------------------------------------- */
+/*
+ * A fragment with punctuation, typed a key at a time as a telnet client in
+ * character mode sends it, completes to the only word matching it.
+ */
+static int check_fuzzy(void)
+{
+	static const char *const words[] = {
+		"vrf-blue-01", "vrf-red-02", "vrfblue-03", "tunnel-blue-04"
+	};
+	const char *fragment = "vrf-bl\t";
+	FILE *in = tmpfile(), *out = tmpfile();
+	tinyrl_t *t;
+	unsigned i;
+	int failed = 0;
+
+	fuzzy = tinyrl_fuzzy_new();
+	t = tinyrl_new(in, out);
+	if (!t || !fuzzy) {
+		fprintf(stderr, "FAIL: tinyrl_new\n");
+		return 1;
+	}
+	for (i = 0; i < sizeof(words) / sizeof(words[0]); i++)
+		tinyrl_fuzzy_add(fuzzy, words[i]);
+	tinyrl__set_output(t, test_write, NULL);
+	tinyrl_bind_key(t, '\t', fuzzy_key, t);
+
+	tinyrl_readline_begin(t, "> ");
+	for (i = 0; fragment[i]; i++)
+		tinyrl_feed(t, fragment + i, 1, NULL);
+	if (strncmp(tinyrl__get_line(t), "vrf-blue-01", 11)) {
+		fprintf(stderr, "FAIL: vrf-bl completes to %s\n", tinyrl__get_line(t));
+		failed = 1;
+	}
+
+	tinyrl_delete(t);
+	tinyrl_fuzzy_delete(fuzzy);
+	fclose(in);
+	fclose(out);
+	return failed;
+}
+
+/*------------------------------------- */
+int main(void)
+{
+	char *matches[] = {
+		"interface_counters_detailed",
+		"interface_status_detailed",
+		"interface_transceiver_detailed",
+		NULL
+	};
+	FILE *in = tmpfile(), *out = tmpfile();
+	tinyrl_t *t;
+	unsigned i;
+	int failed = 0;
+
+	/* a display which never ends fails by the alarm */
+	alarm(5);
+
+	t = tinyrl_new(in, out);
+	if (!t) {
+		fprintf(stderr, "FAIL: tinyrl_new\n");
+		return EXIT_FAILURE;
+	}
+	tinyrl__set_output(t, test_write, NULL);
+
+	tinyrl__set_width(t, 1);
+	if (tinyrl__get_width(t) != TINYRL_MIN_WIDTH) {
+		fprintf(stderr, "FAIL: width 1 is taken as %u\n", tinyrl__get_width(t));
+		failed = 1;
+	}
+
+	tinyrl_display_matches(t, matches);
+	tinyrl_flush(t);
+
+	/* each match wider than the terminal is on a line of its own */
+	for (i = 0; matches[i]; i++) {
+		if (count_lines(output, output_len, matches[i]) != 1) {
+			fprintf(stderr, "FAIL: %s not displayed once\n", matches[i]);
+			failed = 1;
+		}
+	}
+	if (count_lines(output, output_len, "\n") > 8) {
+		fprintf(stderr, "FAIL: %u line ends for 3 matches\n",
+			count_lines(output, output_len, "\n"));
+		failed = 1;
+	}
+
+	tinyrl__set_width(t, 0);
+	if (tinyrl__get_width(t) != 80) {
+		fprintf(stderr, "FAIL: width 0 does not go back to the default\n");
+		failed = 1;
+	}
+
+	tinyrl_delete(t);
+	fclose(in);
+	fclose(out);
+
+	failed |= check_fuzzy();
+	if (!failed)
+		printf("PASS\n");
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
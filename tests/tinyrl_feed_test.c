@@ -0,0 +1,109 @@
+/*
+ * tinyrl_feed_test.c
+ *
+ * Input fed a byte at a time, as sent by a telnet client in character
+ * mode: quotes, escapes and punctuation reach the line, and the command
+ * line splits into the words typed. Built and run from the top of the
+ * tree:
+ *
+ *     cc -Iinclude -o tinyrl_feed_test tests/tinyrl_feed_test.c \
+ *        src/cli_command*.c src/tinyrl*.c -lpthread && ./tinyrl_feed_test
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "main.h"
+
+/* the application commands, linked from main.c by the application */
+void cli_command_1(tinyrl_t * this, int argc, const cli_token_t *argv)
+{
+}
+
+void cli_command_2(tinyrl_t * this, int argc, const cli_token_t *argv)
+{
+}
+
+/*------------------------------------- */
+static ssize_t test_write(void *context, const char *buf, size_t len)
+{
+	return len;
+}
+
+/*------------------------------------- */
+/*
+ * Feed text a byte at a time followed by enter, and check the line read
+ * and the words it splits into.
+ */
+static int check_line(const char *text, int argc, const char *const *words)
+{
+	FILE *in = tmpfile(), *out = tmpfile();
+	cli_token_t argv[CLI_COMMAND_ARGS];
+	tinyrl_feed_t result = TINYRL_FEED_MORE;
+	char *line;
+	size_t i;
+	tinyrl_t *t;
+	int n, failed = 0;
+
+	t = tinyrl_new(in, out);
+	if (!t) {
+		fprintf(stderr, "FAIL: setup\n");
+		return 1;
+	}
+	tinyrl__set_output(t, test_write, NULL);
+
+	tinyrl_readline_begin(t, "> ");
+	for (i = 0; text[i]; i++)
+		tinyrl_feed(t, text + i, 1, NULL);
+	result = tinyrl_feed(t, "\r", 1, NULL);
+	if (result != TINYRL_FEED_LINE) {
+		fprintf(stderr, "FAIL: %s: no line\n", text);
+		failed = 1;
+		goto out;
+	}
+
+	line = tinyrl_readline_end(t);
+	if (!line || strcmp(line, text)) {
+		fprintf(stderr, "FAIL: %s: line read is %s\n", text, line ? line : "NULL");
+		failed = 1;
+	} else {
+		n = cli_command_tokenize(line, argv, CLI_COMMAND_ARGS);
+		if (n != argc) {
+			fprintf(stderr, "FAIL: %s: %d words\n", text, n);
+			failed = 1;
+		}
+		for (i = 0; !failed && i < (size_t) argc; i++) {
+			if (strcmp(argv[i].s, words[i])) {
+				fprintf(stderr, "FAIL: %s: word %zu is %s\n", text, i, argv[i].s);
+				failed = 1;
+			}
+		}
+	}
+	free(line);
+
+out:
+	tinyrl_delete(t);
+	fclose(in);
+	fclose(out);
+	return failed;
+}
+
+/*------------------------------------- */
+int main(void)
+{
+	static const char *const quoted[] = { "help", "com x" };
+	static const char *const single[] = { "show", "a \"b\"" };
+	static const char *const escaped[] = { "set", "a b", "c\\d" };
+	static const char *const punct[] = { "vrf-blue", "10.0.0.1/24", "a,b:c" };
+	int failed = 0;
+
+	failed |= check_line("help \"com x\"", 2, quoted);
+	failed |= check_line("show 'a \"b\"'", 2, single);
+	failed |= check_line("set a\\ b c\\\\d", 3, escaped);
+	failed |= check_line("vrf-blue 10.0.0.1/24 a,b:c", 3, punct);
+
+	if (!failed)
+		printf("PASS\n");
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
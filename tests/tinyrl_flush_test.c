@@ -0,0 +1,95 @@
+/*
+ * tinyrl_flush_test.c
+ *
+ * Output queued for a non blocking socket which cannot take all of it, as
+ * for a telnet client not reading. Built and run from the top of the tree:
+ *
+ *     cc -Iinclude -o tinyrl_flush_test tests/tinyrl_flush_test.c \
+ *        src/tinyrl*.c -lpthread && ./tinyrl_flush_test
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+
+#include "tinyrl.h"
+
+#define TEST_LINES 20000
+
+/*------------------------------------- */
+int main(void)
+{
+	char line[64], buf[4096];
+	char *expected;
+	size_t expected_len = 0, received_len = 0;
+	FILE *stream;
+	tinyrl_t *t;
+	int fds[2], r;
+	unsigned i;
+	ssize_t n;
+	int failed = 0;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) {
+		fprintf(stderr, "FAIL: socketpair\n");
+		return EXIT_FAILURE;
+	}
+	fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+	stream = fdopen(fds[0], "w+");
+	t = tinyrl_new(stream, stream);
+	expected = malloc(TEST_LINES * sizeof(line));
+	if (!stream || !t || !expected) {
+		fprintf(stderr, "FAIL: setup\n");
+		return EXIT_FAILURE;
+	}
+
+	/* far more than the socket buffers take */
+	for (i = 0; i < TEST_LINES; i++) {
+		int len = snprintf(line, sizeof(line), "output line %u\n", i);
+
+		tinyrl_write(t, line, len);
+		memcpy(expected + expected_len, line, len);
+		expected_len += len;
+	}
+
+	r = tinyrl_flush(t);
+	if (r != TINYRL_FLUSH_PENDING) {
+		fprintf(stderr, "FAIL: full socket flushed with %d\n", r);
+		failed = 1;
+	}
+
+	/* the client reads, what was kept is sent in order */
+	while (received_len < expected_len) {
+		n = read(fds[1], buf, sizeof(buf));
+		if (n <= 0)
+			break;
+		if (memcmp(buf, expected + received_len, n)) {
+			fprintf(stderr, "FAIL: output out of order at %zu\n", received_len);
+			failed = 1;
+			break;
+		}
+		received_len += n;
+		if (tinyrl_flush(t) < 0) {
+			fprintf(stderr, "FAIL: flush error\n");
+			failed = 1;
+			break;
+		}
+	}
+	if (received_len != expected_len) {
+		fprintf(stderr, "FAIL: %zu bytes of %zu received\n", received_len, expected_len);
+		failed = 1;
+	}
+	if (tinyrl_flush(t) != 0) {
+		fprintf(stderr, "FAIL: empty queue not flushed\n");
+		failed = 1;
+	}
+
+	tinyrl_delete(t);
+	fclose(stream);
+	close(fds[1]);
+	free(expected);
+	if (!failed)
+		printf("PASS\n");
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,86 @@
+/*
+ * tinyrl_line_limit_test.c
+ *
+ * Line length limits below and above the storage inside the instance
+ * (TINYRL_INLINE_SIZE). Built and run from the top of the tree:
+ *
+ *     cc -Iinclude -o tinyrl_line_limit_test tests/tinyrl_line_limit_test.c \
+ *        src/tinyrl*.c -lpthread && ./tinyrl_line_limit_test
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tinyrl.h"
+
+/*------------------------------------- */
+static ssize_t test_write(void *context, const char *buf, size_t len)
+{
+	return len;
+}
+
+/*------------------------------------- */
+/*
+ * Type len characters into an instance limited to limit, in one chunk or
+ * a byte at a time, and check the line holds limit - 1 of them.
+ */
+static int check_limit(unsigned limit, unsigned len, int bytewise)
+{
+	FILE *in = tmpfile(), *out = tmpfile();
+	char *text = malloc(len);
+	size_t got;
+	unsigned i;
+	tinyrl_t *t;
+	int failed = 0;
+
+	t = tinyrl_new(in, out);
+	if (!t || !text) {
+		fprintf(stderr, "FAIL: setup\n");
+		return 1;
+	}
+	tinyrl__set_output(t, test_write, NULL);
+	tinyrl_limit_line_length(t, limit);
+
+	for (i = 0; i < len; i++)
+		text[i] = 'a' + i % 26;
+
+	tinyrl_readline_begin(t, "> ");
+	if (bytewise) {
+		for (i = 0; i < len; i++)
+			tinyrl_feed(t, text + i, 1, NULL);
+	} else {
+		tinyrl_feed(t, text, len, NULL);
+	}
+
+	got = strlen(tinyrl__get_line(t));
+	if (got != limit - 1) {
+		fprintf(stderr, "FAIL: limit %u, %u characters typed%s, line of %zu\n",
+			limit, len, bytewise ? " a byte at a time" : "", got);
+		failed = 1;
+	} else if (memcmp(tinyrl__get_line(t), text, got)) {
+		fprintf(stderr, "FAIL: limit %u, line does not hold the first characters\n", limit);
+		failed = 1;
+	}
+
+	tinyrl_delete(t);
+	fclose(in);
+	fclose(out);
+	free(text);
+	return failed;
+}
+
+/*------------------------------------- */
+int main(void)
+{
+	int failed = 0;
+
+	failed |= check_limit(10, 26, 0);
+	failed |= check_limit(10, 26, 1);
+	failed |= check_limit(TINYRL_INLINE_SIZE, 2 * TINYRL_INLINE_SIZE, 0);
+	failed |= check_limit(3 * TINYRL_INLINE_SIZE, 4 * TINYRL_INLINE_SIZE, 1);
+
+	if (!failed)
+		printf("PASS\n");
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,394 @@
+/**
+ * @file cli_command_gen.c
+ * @brief Generate the table of the commands known at build time
+ *
+ * Reads a spec of commands and writes the C source of their table, laid out
+ * along a minimal perfect hash of the commands and of the words leading to
+ * them (see cli_command_hash.h). Each line of the spec is
+ *
+ *     words of the command | handler | flags | documentation
+ *
+ * where flags is empty, or "path" when the arguments of the command are the
+ * words of a command (e.g. help). Lines starting with # are comments.
+ *
+ * Built and run from the top of the tree:
+ *
+ *     cc -Iinclude -o cli_command_gen tools/cli_command_gen.c
+ *     ./cli_command_gen src/cli_command_table.def > src/cli_command_table.c
+ */
+
+/* make sure we can get qsort_r() */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "cli_command_hash.h"
+
+/** @brief Longest line of the spec */
+#define CLI_COMMAND_GEN_LINE 1024
+/** @brief Keys per bucket, on average */
+#define CLI_COMMAND_GEN_BUCKET_SIZE 2
+/** @brief Displacements tried for a bucket before giving up */
+#define CLI_COMMAND_GEN_TRIES 1000000
+
+/** @brief Command, or word leading to commands */
+typedef struct
+{
+	char *path; /**@brief Words from the first one, separated by one space */
+	unsigned parent; /**@brief Key of the words before, CLI_COMMAND_HASH_NONE if none */
+	unsigned word; /**@brief Offset of the last word in path */
+	char *func; /**@brief Handler, NULL for a word only leading to other commands */
+	char *doc;
+	int args_path;
+	uint64_t hash;
+	unsigned bucket;
+	unsigned slot;
+} cli_command_gen_key_t;
+
+static cli_command_gen_key_t *keys;
+static unsigned keys_count;
+static unsigned keys_size;
+
+/**
+ * @brief  Exit on an error
+ * @param  spec Name of the spec
+ * @param  line Line of the error, 0 if none
+ * @param  message What is wrong
+ **/
+static void cli_command_gen_fail(const char *spec, unsigned line, const char *message)
+{
+	if (line)
+		fprintf(stderr, "%s:%u: %s\n", spec, line, message);
+	else
+		fprintf(stderr, "%s: %s\n", spec, message);
+	exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief  Strip whitespace from the start and end of a field
+ * @param  s Field
+ * @return Field trimmed, in place
+ **/
+static char *cli_command_gen_trim(char *s)
+{
+	char *end;
+
+	while (isspace((unsigned char) *s))
+		s++;
+	end = s + strlen(s);
+	while (end > s && isspace((unsigned char) end[-1]))
+		end--;
+	*end = '\0';
+	return s;
+}
+
+/**
+ * @brief  Find or add the key of words
+ * @param  path Words, separated by one space
+ * @param  len Length of the words
+ * @return Index of the key
+ **/
+static unsigned cli_command_gen_key(const char *path, size_t len)
+{
+	cli_command_gen_key_t *key;
+	const char *space;
+	unsigned parent = CLI_COMMAND_HASH_NONE;
+	unsigned i;
+
+	for (i = 0; i < keys_count; i++)
+	{
+		if (strlen(keys[i].path) == len && !memcmp(keys[i].path, path, len))
+			return i;
+	}
+
+	/* the words before have their own key, their hash is carried on */
+	for (space = path + len; space > path && space[-1] != ' '; space--)
+		;
+	if (space > path)
+		parent = cli_command_gen_key(path, space - path - 1);
+
+	if (keys_count == keys_size)
+	{
+		keys_size = keys_size ? 2 * keys_size : 64;
+		keys = realloc(keys, keys_size * sizeof(*keys));
+		if (!keys)
+			cli_command_gen_fail("cli_command_gen", 0, "out of memory");
+	}
+	key = &keys[keys_count];
+	memset(key, 0, sizeof(*key));
+	key->path = strndup(path, len);
+	key->parent = parent;
+	key->word = space - path;
+	if (parent == CLI_COMMAND_HASH_NONE)
+		key->hash = cli_command_hash_word(CLI_COMMAND_HASH_INIT, path, len, true);
+	else
+		key->hash = cli_command_hash_word(keys[parent].hash, space, len - key->word, false);
+	return keys_count++;
+}
+
+/**
+ * @brief  Read the spec, each command with the words leading to it
+ * @param  spec Name of the spec
+ **/
+static void cli_command_gen_read(const char *spec)
+{
+	char buf[CLI_COMMAND_GEN_LINE], path[CLI_COMMAND_GEN_LINE];
+	char *field[4], *s, *words;
+	unsigned line = 0, n, i;
+	size_t len;
+	FILE *f;
+
+	f = fopen(spec, "r");
+	if (!f)
+		cli_command_gen_fail(spec, 0, "cannot be read");
+
+	while (fgets(buf, sizeof(buf), f))
+	{
+		line++;
+		s = cli_command_gen_trim(buf);
+		if (!*s || *s == '#')
+			continue;
+
+		for (n = 0; n < 4; n++)
+		{
+			field[n] = s;
+			s = strchr(s, '|');
+			if (!s)
+				break;
+			*s++ = '\0';
+		}
+		if (n != 3)
+			cli_command_gen_fail(spec, line, "expected: words | handler | flags | documentation");
+		for (n = 0; n < 4; n++)
+			field[n] = cli_command_gen_trim(field[n]);
+		if (!*field[1])
+			cli_command_gen_fail(spec, line, "no handler");
+		if (*field[2] && strcmp(field[2], "path"))
+			cli_command_gen_fail(spec, line, "unknown flag");
+
+		/* the words, separated by one space */
+		len = 0;
+		for (words = strtok(field[0], " \t"); words; words = strtok(NULL, " \t"))
+		{
+			if (len)
+				path[len++] = ' ';
+			memcpy(path + len, words, strlen(words));
+			len += strlen(words);
+		}
+		if (!len)
+			cli_command_gen_fail(spec, line, "no words");
+
+		i = cli_command_gen_key(path, len);
+		if (keys[i].func)
+			cli_command_gen_fail(spec, line, "command already in the spec");
+		keys[i].func = strdup(field[1]);
+		keys[i].doc = strdup(field[3]);
+		keys[i].args_path = !!*field[2];
+	}
+	fclose(f);
+
+	if (keys_count >= CLI_COMMAND_HASH_NONE)
+		cli_command_gen_fail(spec, 0, "too many commands");
+}
+
+/**
+ * @brief  Compare buckets by decreasing size
+ **/
+static int cli_command_gen_bucket_cmp(const void *a, const void *b, void *sizes)
+{
+	const unsigned *size = sizes;
+	unsigned x = *(const unsigned *) a, y = *(const unsigned *) b;
+
+	if (size[x] != size[y])
+		return size[x] < size[y] ? 1 : -1;
+	return x < y ? -1 : x > y;
+}
+
+/**
+ * @brief  Choose the displacement of each bucket, the largest buckets first
+ * @param  spec Name of the spec
+ * @param  buckets Number of buckets
+ * @return Displacements
+ **/
+static unsigned *cli_command_gen_hash(const char *spec, unsigned buckets)
+{
+	unsigned *displacement, *size, *first, *member, *order, *slot;
+	unsigned char *taken;
+	unsigned b, i, j, k, d, n;
+
+	displacement = calloc(buckets, sizeof(*displacement));
+	size = calloc(buckets, sizeof(*size));
+	first = calloc(buckets + 1, sizeof(*first));
+	member = calloc(keys_count + 1, sizeof(*member));
+	order = calloc(buckets, sizeof(*order));
+	slot = calloc(keys_count + 1, sizeof(*slot));
+	taken = calloc(keys_count + 1, 1);
+	if (!displacement || !size || !first || !member || !order || !slot || !taken)
+		cli_command_gen_fail(spec, 0, "out of memory");
+
+	for (i = 0; i < keys_count; i++)
+	{
+		for (j = 0; j < i; j++)
+		{
+			if (keys[i].hash == keys[j].hash)
+				cli_command_gen_fail(spec, 0, "two commands have the same hash");
+		}
+		keys[i].bucket = cli_command_hash_bucket(keys[i].hash, buckets);
+		size[keys[i].bucket]++;
+	}
+
+	/* the keys of each bucket, one after the other */
+	for (b = 0; b < buckets; b++)
+		first[b + 1] = first[b] + size[b];
+	for (i = 0; i < keys_count; i++)
+		member[first[keys[i].bucket]++] = i;
+	for (b = 0; b < buckets; b++)
+		first[b] -= size[b];
+
+	for (b = 0; b < buckets; b++)
+		order[b] = b;
+	qsort_r(order, buckets, sizeof(*order), cli_command_gen_bucket_cmp, size);
+
+	for (b = 0; b < buckets && size[order[b]]; b++)
+	{
+		const unsigned *keys_of = member + first[order[b]];
+
+		n = size[order[b]];
+		for (d = 0; d < CLI_COMMAND_GEN_TRIES; d++)
+		{
+			for (i = 0; i < n; i++)
+			{
+				k = cli_command_hash_slot(keys[keys_of[i]].hash, d, keys_count);
+				for (j = 0; j < i && slot[j] != k; j++)
+					;
+				if (taken[k] || j < i)
+					break;
+				slot[i] = k;
+			}
+			if (i == n)
+				break;
+		}
+		if (d == CLI_COMMAND_GEN_TRIES)
+			cli_command_gen_fail(spec, 0, "no perfect hash found");
+
+		displacement[order[b]] = d;
+		for (i = 0; i < n; i++)
+		{
+			keys[keys_of[i]].slot = slot[i];
+			taken[slot[i]] = 1;
+		}
+	}
+
+	free(size);
+	free(first);
+	free(member);
+	free(order);
+	free(slot);
+	free(taken);
+	return displacement;
+}
+
+/**
+ * @brief  Write a string as a C literal
+ * @param  s String
+ **/
+static void cli_command_gen_string(const char *s)
+{
+	putchar('"');
+	for (; *s; s++)
+	{
+		if (*s == '"' || *s == '\\')
+			putchar('\\');
+		putchar(*s);
+	}
+	putchar('"');
+}
+
+/**
+ * @brief  Write the table, its keys in the order of their slots
+ * @param  spec Name of the spec
+ * @param  buckets Number of buckets
+ * @param  displacement Displacement of each bucket
+ **/
+static void cli_command_gen_write(const char *spec, unsigned buckets, const unsigned *displacement)
+{
+	cli_command_gen_key_t **by_slot;
+	const char *name;
+	unsigned i, j;
+
+	by_slot = calloc(keys_count ? keys_count : 1, sizeof(*by_slot));
+	if (!by_slot)
+		cli_command_gen_fail(spec, 0, "out of memory");
+	for (i = 0; i < keys_count; i++)
+		by_slot[keys[i].slot] = &keys[i];
+
+	name = strrchr(spec, '/');
+	name = name ? name + 1 : spec;
+	printf("/**\n"
+	       " * @file cli_command_table.c\n"
+	       " * @brief Commands known at build time, generated by cli_command_gen from\n"
+	       " *        %s. Do not edit.\n"
+	       " */\n\n"
+	       "#include \"cli_command.h\"\n\n", name);
+
+	for (i = 0; i < keys_count; i++)
+	{
+		if (!keys[i].func)
+			continue;
+		for (j = 0; j < i && (!keys[j].func || strcmp(keys[i].func, keys[j].func)); j++)
+			;
+		if (j == i)
+			printf("cli_command_func_t %s;\n", keys[i].func);
+	}
+
+	printf("\nconst unsigned cli_command_static_count = %u;\n", keys_count);
+	printf("const unsigned cli_command_static_buckets = %u;\n\n", buckets);
+
+	printf("const unsigned cli_command_static_displacement[] =\n{");
+	for (i = 0; i < buckets; i++)
+		printf("%s%u", i % 16 ? ", " : i ? ",\n" : " ", displacement[i]);
+	printf(" };\n\n");
+
+	printf("const cli_command_static_t cli_command_static[] =\n{\n");
+	for (i = 0; i < keys_count; i++)
+	{
+		cli_command_gen_key_t *key = by_slot[i];
+
+		printf("{ ");
+		cli_command_gen_string(key->path);
+		if (key->parent == CLI_COMMAND_HASH_NONE)
+			printf(", CLI_COMMAND_HASH_NONE");
+		else
+			printf(", %u", keys[key->parent].slot);
+		printf(", %u, %u, %s, ", key->word, (unsigned) strlen(key->path) - key->word,
+		       key->func ? key->func : "NULL");
+		cli_command_gen_string(key->doc ? key->doc : "");
+		printf(", %s },\n", key->args_path ? "true" : "false");
+	}
+	if (!keys_count)
+		printf("{ \"\", CLI_COMMAND_HASH_NONE, 0, 0, NULL, \"\", false },\n");
+	printf("};\n");
+	free(by_slot);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned *displacement;
+	unsigned buckets;
+
+	if (argc != 2)
+	{
+		fprintf(stderr, "usage: %s spec > table.c\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	cli_command_gen_read(argv[1]);
+	buckets = keys_count / CLI_COMMAND_GEN_BUCKET_SIZE + 1;
+	displacement = cli_command_gen_hash(argv[1], buckets);
+	cli_command_gen_write(argv[1], buckets, displacement);
+	free(displacement);
+	return fflush(stdout) ? EXIT_FAILURE : EXIT_SUCCESS;
+}